@@ -0,0 +1,122 @@
+// Compares the baseline compiler (`calc::compileBaseline()`) with the
+// JIT (`calc::compile()`): how long compiling an expression takes, and
+// how fast the code evaluates it. The expressions are random, and
+// every one is compiled both ways and evaluated on the same rows.
+// The results must be identical.
+
+#include "LibCalc.hpp"
+#include "Measure.hpp"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static llvm::cl::opt<unsigned>
+	NumExprs("exprs", llvm::cl::desc("Number of expressions"),
+			 llvm::cl::init(200));
+
+static llvm::cl::opt<unsigned>
+	NumOps("ops", llvm::cl::desc("Number of operators per expression"),
+		   llvm::cl::init(16));
+
+static llvm::cl::opt<unsigned>
+	NumRows("rows", llvm::cl::desc("Number of input rows per expression"),
+			llvm::cl::init(1 << 14));
+
+namespace {
+const char *const Vars[] = {"a", "b", "c", "d"};
+
+// A random tree with NumOps operators. Only numbers are divisors, so
+// nothing divides by zero, and with small inputs nothing overflows
+std::string generateExpr(std::mt19937 &Gen, unsigned Ops) {
+    std::uniform_int_distribution<unsigned> Leaf(0, 4);
+    if (Ops == 0) {
+        unsigned L = Leaf(Gen);
+        return L < 4 ? Vars[L] : std::to_string(Gen() % 10);
+    }
+    unsigned Left = std::uniform_int_distribution<unsigned>(0, Ops - 1)(Gen);
+    switch (Gen() % 4) {
+    case 0:
+        return "(" + generateExpr(Gen, Left) + "+" +
+               generateExpr(Gen, Ops - 1 - Left) + ")";
+    case 1:
+        return "(" + generateExpr(Gen, Left) + "-" +
+               generateExpr(Gen, Ops - 1 - Left) + ")";
+    case 2:
+        return "(" + generateExpr(Gen, Left) + "*" +
+               generateExpr(Gen, Ops - 1 - Left) + ")";
+    default:
+        return "(" + generateExpr(Gen, Ops - 1) + "/" +
+               std::to_string(Gen() % 9 + 1) + ")";
+    }
+}
+
+calc::CompiledExpr check(llvm::Expected<calc::CompiledExpr> E) {
+    if (!E) {
+        llvm::errs() << llvm::toString(E.takeError()) << "\n";
+        exit(1);
+    }
+    return *E;
+}
+} // namespace
+
+int main(int argc, const char **argv) {
+	llvm::InitLLVM X(argc, argv);
+	llvm::cl::ParseCommandLineOptions(
+		argc, argv, "calc-baseline-bench - baseline compiler vs. JIT\n");
+
+	std::mt19937 Gen(42);
+	std::vector<std::string> Exprs;
+	for (unsigned I = 0; I < NumExprs; ++I)
+		Exprs.push_back("with a,b,c,d: " + generateExpr(Gen, NumOps));
+
+	std::vector<calc::CompiledExpr> Baseline, JIT;
+	double BaselineCompile = measure([&] {
+		for (const std::string &Expr : Exprs)
+			Baseline.push_back(check(calc::compileBaseline(Expr)));
+	});
+	double JITCompile = measure([&] {
+		for (const std::string &Expr : Exprs)
+			JIT.push_back(check(calc::compile(Expr)));
+	});
+
+	std::uniform_int_distribution<int32_t> Dist(-10, 10);
+	std::vector<int32_t> Rows(size_t(NumRows) * 4);
+	for (int32_t &V : Rows)
+		V = Dist(Gen);
+	std::vector<int32_t> Reference(NumRows), Results(NumRows);
+	double BaselineTime = 0, JITTime = 0;
+	for (unsigned I = 0; I < NumExprs; ++I) {
+		BaselineTime += measure([&] {
+			for (size_t R = 0; R < NumRows; ++R)
+				Results[R] = Baseline[I](&Rows[R * 4]);
+		});
+		JITTime += measure([&] {
+			for (size_t R = 0; R < NumRows; ++R)
+				Reference[R] = JIT[I](&Rows[R * 4]);
+		});
+		if (Results != Reference) {
+			llvm::errs() << Exprs[I] << ": results differ\n";
+			return 1;
+		}
+	}
+
+	double Evals = double(NumExprs) * NumRows;
+	llvm::outs() << llvm::format("%u expressions with %u operators, %u rows\n",
+								 unsigned(NumExprs), unsigned(NumOps),
+								 unsigned(NumRows));
+	llvm::outs() << llvm::format("baseline: compile %10.1f us/expr, %6.2f ns/row\n",
+								 BaselineCompile * 1e6 / NumExprs,
+								 BaselineTime * 1e9 / Evals);
+	llvm::outs() << llvm::format("jit:      compile %10.1f us/expr, %6.2f ns/row\n",
+								 JITCompile * 1e6 / NumExprs,
+								 JITTime * 1e9 / Evals);
+	return 0;
+}
@@ -0,0 +1,377 @@
+// End-to-end compile benchmark for calc. Expressions of several
+// shapes are generated at sizes growing by powers of ten, and the
+// time spent in every phase of the compiler is measured:
+//
+//   lexer   - a standalone pass tokenizing the whole input
+//   parser  - Parser::parse(), which includes its own lexing
+//   sema    - Sema::semantic()
+//   codegen - CodeGen::generate(), without printing the IR
+//
+// Every case runs in a forked child process so that the reported
+// peak RSS belongs to that case alone. The results are written as
+// JSON, which makes it easy to diff two builds. For every phase the
+// JSON also holds the scaling exponent against the previous size of
+// the same shape: 1.0 is linear growth, clearly larger values point
+// at superlinear behavior and are highlighted in the summary.
+
+#include "CodeGen.hpp"
+#include "Parser.hpp"
+#include "Sema.hpp"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static llvm::cl::opt<std::string>
+	OutputFile("o", llvm::cl::desc("Write the JSON results to <file>"),
+			   llvm::cl::value_desc("file"), llvm::cl::init("-"));
+
+static llvm::cl::opt<uint64_t>
+	MinSize("min-size", llvm::cl::desc("Smallest number of AST nodes"),
+			llvm::cl::init(10));
+
+static llvm::cl::opt<uint64_t>
+	MaxSize("max-size", llvm::cl::desc("Largest number of AST nodes"),
+			llvm::cl::init(10000000));
+
+static llvm::cl::list<std::string>
+	ShapeNames("shape",
+			   llvm::cl::desc("Only run the given shapes (balanced, "
+							  "left-deep, wide-with, literal-heavy)"),
+			   llvm::cl::CommaSeparated);
+
+static llvm::cl::opt<double>
+	SuperlinearThreshold("superlinear-threshold",
+						 llvm::cl::desc("Scaling exponent above which a "
+										"phase is reported as superlinear"),
+						 llvm::cl::init(1.25));
+
+namespace {
+enum Shape { Balanced, LeftDeep, WideWith, LiteralHeavy, NumShapes };
+
+const char *const ShapeSpelling[] = {"balanced", "left-deep", "wide-with",
+									 "literal-heavy"};
+
+enum Phase { PhaseLexer, PhaseParser, PhaseSema, PhaseCodeGen, NumPhases };
+
+const char *const PhaseSpelling[] = {"lexer", "parser", "sema", "codegen"};
+
+// Phases faster than this are too noisy for a scaling exponent
+constexpr double MinScalingSeconds = 1e-3;
+
+// Identifiers consist of letters only, so variable numbers are
+// spelled in base 26. Upper case letters can't form the keyword `with`
+void appendVarName(std::string &Out, uint64_t I) {
+    char Buf[16];
+    unsigned Len = 0;
+    do {
+        Buf[Len++] = 'A' + I % 26;
+        I /= 26;
+    } while (I);
+    while (Len)
+        Out += Buf[--Len];
+}
+
+char opFor(uint64_t I, bool WithDiv) {
+    static const char Ops[] = {'+', '-', '*', '/'};
+    return Ops[I % (WithDiv ? 4 : 3)];
+}
+
+constexpr unsigned NumBalancedVars = 8;
+
+void appendWith(std::string &Out, uint64_t NumVars) {
+    Out += "with ";
+    for (uint64_t I = 0; I < NumVars; ++I) {
+        if (I)
+            Out += ',';
+        appendVarName(Out, I);
+    }
+    Out += ": ";
+}
+
+// A fully parenthesized, balanced tree over `Count` leaves
+void appendBalanced(std::string &Out, uint64_t First, uint64_t Count) {
+    if (Count == 1) {
+        appendVarName(Out, First % NumBalancedVars);
+        return;
+    }
+    uint64_t Half = Count / 2;
+    Out += '(';
+    appendBalanced(Out, First, Half);
+    Out += opFor(First + Half, /*WithDiv=*/true);
+    appendBalanced(Out, First + Half, Count - Half);
+    Out += ')';
+}
+
+// Returns an expression of the given shape with about `Size` AST
+// nodes, leaves and operators together
+std::string generate(Shape S, uint64_t Size) {
+    uint64_t Leaves = std::max<uint64_t>(1, (Size + 1) / 2);
+    std::string Out;
+    switch (S) {
+    case Balanced:
+        appendWith(Out, NumBalancedVars);
+        appendBalanced(Out, 0, Leaves);
+        break;
+    case LeftDeep:
+        // Only additive operators, so the parser builds one long
+        // left-leaning chain
+        appendWith(Out, NumBalancedVars);
+        for (uint64_t I = 0; I < Leaves; ++I) {
+            if (I)
+                Out += opFor(I, /*WithDiv=*/false) == '-' ? '-' : '+';
+            appendVarName(Out, I % NumBalancedVars);
+        }
+        break;
+    case WideWith:
+        // Every leaf is a distinct declared variable
+        appendWith(Out, Leaves);
+        for (uint64_t I = 0; I < Leaves; ++I) {
+            if (I)
+                Out += '+';
+            appendVarName(Out, I);
+        }
+        break;
+    case LiteralHeavy:
+        // Mostly multi-digit literals, with an occasional variable
+        appendWith(Out, 1);
+        for (uint64_t I = 0; I < Leaves; ++I) {
+            if (I)
+                Out += opFor(I, /*WithDiv=*/false);
+            if (I % 16 == 0)
+                appendVarName(Out, 0);
+            else
+                Out += std::to_string(1000 + I % 90000);
+        }
+        break;
+    case NumShapes:
+        break;
+    }
+    return Out;
+}
+
+struct Result {
+    uint64_t InputBytes = 0;
+    uint64_t Tokens = 0;
+    double Seconds[NumPhases] = {};
+    long PeakRSSKiB = 0;
+    bool Failed = false;
+};
+
+template <typename Fn> double timed(Fn &&Run) {
+    auto Start = std::chrono::steady_clock::now();
+    Run();
+    std::chrono::duration<double> Elapsed =
+        std::chrono::steady_clock::now() - Start;
+    return Elapsed.count();
+}
+
+// Runs all phases on one generated input. The AST is deliberately
+// never freed; the process ends right after the case
+Result runCase(Shape S, uint64_t Size) {
+    Result R;
+    std::string Text = generate(S, Size);
+    R.InputBytes = Text.size();
+
+    R.Seconds[PhaseLexer] = timed([&] {
+        Lexer Lex(Text);
+        Token Tok;
+        do {
+            Lex.next(Tok);
+            ++R.Tokens;
+        } while (!Tok.is(Token::eoi));
+    });
+
+    AST *Tree = nullptr;
+    bool SyntaxError = false;
+    R.Seconds[PhaseParser] = timed([&] {
+        Lexer Lex(Text);
+        Parser P(Lex);
+        Tree = P.parse();
+        SyntaxError = P.hasError();
+    });
+    if (!Tree || SyntaxError) {
+        R.Failed = true;
+        return R;
+    }
+
+    bool SemaError = false;
+    R.Seconds[PhaseSema] =
+        timed([&] { SemaError = Sema().semantic(Tree); });
+    if (SemaError) {
+        R.Failed = true;
+        return R;
+    }
+
+    llvm::LLVMContext Ctx;
+    std::unique_ptr<llvm::Module> M;
+    R.Seconds[PhaseCodeGen] =
+        timed([&] { M = CodeGen().generate(Tree, Ctx); });
+
+    struct rusage Usage;
+    getrusage(RUSAGE_SELF, &Usage);
+    R.PeakRSSKiB = Usage.ru_maxrss;
+    return R;
+}
+
+// Runs the case in a child process, which sends back its result
+// through a pipe. A crashed or killed child (e.g. out of memory)
+// is reported as a failed case
+Result runIsolated(Shape S, uint64_t Size) {
+    Result R;
+    int Fds[2];
+    if (pipe(Fds) != 0) {
+        R.Failed = true;
+        return R;
+    }
+    // Anything buffered would otherwise be flushed twice
+    llvm::outs().flush();
+    llvm::errs().flush();
+    pid_t Pid = fork();
+    if (Pid == 0) {
+        close(Fds[0]);
+        Result Child = runCase(S, Size);
+        ssize_t Written = write(Fds[1], &Child, sizeof(Child));
+        _exit(Written == sizeof(Child) ? 0 : 1);
+    }
+    close(Fds[1]);
+    if (Pid < 0 || read(Fds[0], &R, sizeof(R)) != sizeof(R))
+        R.Failed = true;
+    close(Fds[0]);
+    int Status = 0;
+    if (Pid > 0)
+        waitpid(Pid, &Status, 0);
+    if (!WIFEXITED(Status) || WEXITSTATUS(Status) != 0)
+        R.Failed = true;
+    return R;
+}
+
+// Exponent k in t ~ n^k between two consecutive sizes, or NaN if the
+// measurement is too short to say anything
+double scalingExponent(double PrevSeconds, double Seconds, uint64_t PrevSize,
+                       uint64_t Size) {
+    if (PrevSeconds < MinScalingSeconds || Seconds < MinScalingSeconds)
+        return NAN;
+    return std::log(Seconds / PrevSeconds) /
+           std::log(double(Size) / double(PrevSize));
+}
+} // namespace
+
+int main(int argc, const char **argv) {
+	llvm::InitLLVM X(argc, argv);
+	llvm::cl::ParseCommandLineOptions(
+		argc, argv, "calc-bench - compile latency and scaling of calc\n");
+
+	llvm::SmallVector<Shape, 4> Shapes;
+	for (const std::string &Name : ShapeNames) {
+		auto *It = llvm::find(ShapeSpelling, Name);
+		if (It == std::end(ShapeSpelling)) {
+			llvm::errs() << "Unknown shape " << Name << "\n";
+			return 1;
+		}
+		Shapes.push_back(static_cast<Shape>(It - std::begin(ShapeSpelling)));
+	}
+	if (Shapes.empty())
+		Shapes = {Balanced, LeftDeep, WideWith, LiteralHeavy};
+	if (MinSize == 0 || MinSize > MaxSize) {
+		llvm::errs() << "Invalid size range\n";
+		return 1;
+	}
+
+	std::error_code EC;
+	llvm::ToolOutputFile Out(OutputFile, EC, llvm::sys::fs::OF_Text);
+	if (EC) {
+		llvm::errs() << "Cannot open " << OutputFile << ": "
+					 << EC.message() << "\n";
+		return 1;
+	}
+
+	llvm::json::OStream J(Out.os(), /*IndentSize=*/2);
+	bool AnySuperlinear = false;
+	J.objectBegin();
+	J.attribute("benchmark", "calc");
+	J.attributeArray("results", [&] {
+		for (Shape S : Shapes) {
+			uint64_t PrevSize = 0;
+			Result Prev;
+			for (uint64_t Size = MinSize; Size <= MaxSize; Size *= 10) {
+				Result R = runIsolated(S, Size);
+				llvm::errs() << llvm::format("%-14s %10llu nodes",
+											 ShapeSpelling[S],
+											 (unsigned long long)Size);
+
+				J.objectBegin();
+				J.attribute("shape", ShapeSpelling[S]);
+				J.attribute("nodes", int64_t(Size));
+				if (R.Failed) {
+					J.attribute("error", "failed");
+					J.objectEnd();
+					llvm::errs() << "  failed\n";
+					PrevSize = 0;
+					continue;
+				}
+
+				double Exponent[NumPhases];
+				for (unsigned P = 0; P < NumPhases; ++P)
+					Exponent[P] = PrevSize ? scalingExponent(Prev.Seconds[P],
+															 R.Seconds[P],
+															 PrevSize, Size)
+										   : NAN;
+
+				J.attribute("input_bytes", int64_t(R.InputBytes));
+				J.attribute("tokens", int64_t(R.Tokens));
+				J.attribute("peak_rss_kib", int64_t(R.PeakRSSKiB));
+				J.attributeObject("seconds", [&] {
+					for (unsigned P = 0; P < NumPhases; ++P)
+						J.attribute(PhaseSpelling[P], R.Seconds[P]);
+				});
+				J.attributeObject("scaling_exponent", [&] {
+					// JSON has no NaN, so unknown exponents are null
+					for (unsigned P = 0; P < NumPhases; ++P) {
+						if (std::isnan(Exponent[P]))
+							J.attribute(PhaseSpelling[P], nullptr);
+						else
+							J.attribute(PhaseSpelling[P], Exponent[P]);
+					}
+				});
+				J.objectEnd();
+
+				for (unsigned P = 0; P < NumPhases; ++P)
+					llvm::errs() << llvm::format("  %s %7.1f ns/node",
+												 PhaseSpelling[P],
+												 R.Seconds[P] * 1e9 / Size);
+				llvm::errs() << llvm::format("  rss %ld KiB", R.PeakRSSKiB);
+				for (unsigned P = 0; P < NumPhases; ++P) {
+					if (Exponent[P] > SuperlinearThreshold) {
+						llvm::errs() << llvm::format("  [%s superlinear n^%.2f]",
+													 PhaseSpelling[P],
+													 Exponent[P]);
+						AnySuperlinear = true;
+					}
+				}
+				llvm::errs() << "\n";
+				Prev = R;
+				PrevSize = Size;
+			}
+		}
+	});
+	J.attribute("superlinear", AnySuperlinear);
+	J.objectEnd();
+	Out.os() << "\n";
+	Out.keep();
+	return 0;
+}
@@ -0,0 +1,83 @@
+// Checks `calc::ct` against libcalc and compares their speed. Every
+// expression is evaluated both ways on the same random inputs, and the
+// results must be identical. The static_asserts check the compile
+// time evaluation itself.
+
+#include "ConstCalc.hpp"
+#include "LibCalc.hpp"
+#include "Measure.hpp"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+static_assert(calc::ct<"with a: a*2">(21) == 42);
+static_assert(calc::ct<"with a,b: a*(b+3)">(2, 4) == 14);
+static_assert(calc::ct<"1+2*3-8/(2+2)">() == 5);
+static_assert(calc::ct<"with x,y: ((x)) - y - 1">(10, 3) == 6);
+static_assert(calc::ct<"with a: 7/a">(-2) == -3);
+static_assert(calc::ct<"2147483647">() == 2147483647);
+static_assert(calc::ct_num_vars<"with a,b,c: a"> == 3);
+
+static llvm::cl::opt<unsigned>
+	NumRows("rows", llvm::cl::desc("Number of random inputs per expression"),
+			llvm::cl::init(1 << 22));
+
+namespace {
+// Values are kept small and positive, so that no expression below
+// overflows or divides by zero
+template <calc::ct_detail::FixedString Source> bool check() {
+    constexpr unsigned NumVars = calc::ct_num_vars<Source>;
+    llvm::Expected<calc::CompiledExpr> E = calc::compile(Source.Chars);
+    if (!E) {
+        llvm::errs() << llvm::toString(E.takeError()) << "\n";
+        return false;
+    }
+
+    std::vector<int32_t> Rows(size_t(NumRows) * NumVars + 1);
+    std::mt19937 Rng(42);
+    std::uniform_int_distribution<int32_t> Dist(1, 1000);
+    for (int32_t &V : Rows)
+        V = Dist(Rng);
+
+    std::vector<int32_t> JITResults(NumRows), CTResults(NumRows);
+    double JITTime = measure([&] {
+        for (size_t I = 0; I < NumRows; ++I)
+            JITResults[I] = (*E)(&Rows[I * NumVars]);
+    });
+    double CTTime = measure([&] {
+        for (size_t I = 0; I < NumRows; ++I)
+            CTResults[I] = [&]<size_t... Idx>(std::index_sequence<Idx...>) {
+                return calc::ct<Source>(Rows[I * NumVars + Idx]...);
+            }(std::make_index_sequence<NumVars>());
+    });
+
+    if (JITResults != CTResults) {
+        llvm::errs() << Source.Chars << ": results differ\n";
+        return false;
+    }
+    llvm::outs() << llvm::format("%-45s jit %8.2f Mrows/s   ct %8.2f Mrows/s\n",
+                                 (const char *)Source.Chars, NumRows / JITTime / 1e6,
+                                 NumRows / CTTime / 1e6);
+    return true;
+}
+} // namespace
+
+int main(int argc, const char **argv) {
+	llvm::InitLLVM X(argc, argv);
+	llvm::cl::ParseCommandLineOptions(
+		argc, argv, "calc-ct-bench - compile time versus JIT evaluation\n");
+
+	bool OK = check<"with a,b: a*(b+3)">() &&
+	          check<"with a,b,c,d: (a+b)*(c-d)/(d+1) + a*c">() &&
+	          check<"with x: x*x*x - 2*x/7 + 100">() &&
+	          check<"with a,b: ((a+1)*(b+2) - (a-b)) / ((a/b) + 1)">() &&
+	          check<"12*34 - 56/7">();
+	return OK ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+// Measures how evaluating a compiled expression over many rows with
+// `calc::Evaluator` scales with the number of threads. The thread
+// count is doubled from 1 up to the number of cores, and the results
+// of every run are compared with the single threaded ones.
+//
+// With -distinct, the rows repeat that many different tuples, with
+// a skewed (Zipf like) distribution, and a single threaded run with
+// `calc::Memoizer` is measured as well, starting from an empty table.
+//
+// To see the generated code in a profile, run it under `perf record`
+// with CALC_PERF=1 (see `calc::enablePerfSupport()`).
+
+#include "Evaluator.hpp"
+#include "LibCalc.hpp"
+#include "Memoizer.hpp"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+static llvm::cl::opt<std::string>
+	Expr("expr", llvm::cl::desc("Expression to evaluate"),
+		 llvm::cl::init("with a,b,c,d: (a+b)*(c-d)/(d+1) + a*c"));
+
+static llvm::cl::opt<unsigned>
+	NumRows("rows", llvm::cl::desc("Number of input rows"),
+			llvm::cl::init(1 << 24));
+
+static llvm::cl::opt<unsigned>
+	MaxThreads("max-threads",
+			   llvm::cl::desc("Largest thread count (default: all cores)"),
+			   llvm::cl::init(0));
+
+static llvm::cl::opt<unsigned>
+	Iterations("iterations", llvm::cl::desc("Runs per measurement"),
+			   llvm::cl::init(5));
+
+static llvm::cl::opt<unsigned>
+	Distinct("distinct",
+			 llvm::cl::desc("Draw the rows from <n> distinct tuples "
+							"(default: all rows random)"),
+			 llvm::cl::value_desc("n"), llvm::cl::init(0));
+
+static llvm::cl::opt<unsigned>
+	MemoCapacity("memo-capacity",
+				 llvm::cl::desc("Number of entries of the memoization table"),
+				 llvm::cl::init(1 << 16));
+
+namespace {
+double measure(calc::Evaluator &Eval, const calc::CompiledExpr &E,
+               llvm::ArrayRef<int32_t> Rows,
+               llvm::MutableArrayRef<int32_t> Results) {
+    auto Start = std::chrono::steady_clock::now();
+    for (unsigned I = 0; I < Iterations; ++I)
+        Eval.run(E, Rows, Results);
+    std::chrono::duration<double> Elapsed =
+        std::chrono::steady_clock::now() - Start;
+    return Elapsed.count();
+}
+} // namespace
+
+int main(int argc, const char **argv) {
+	llvm::InitLLVM X(argc, argv);
+	llvm::cl::ParseCommandLineOptions(
+		argc, argv, "calc-eval-bench - multi-threaded evaluation throughput\n");
+	if (Iterations == 0) {
+		llvm::errs() << "-iterations must be positive\n";
+		return 1;
+	}
+
+	llvm::Expected<calc::CompiledExpr> E = calc::compile(Expr);
+	if (!E) {
+		llvm::errs() << llvm::toString(E.takeError()) << "\n";
+		return 1;
+	}
+
+	// Small non-negative values, so that a divisor like `d+1`
+	// can't be zero
+	unsigned NumVars = E->getNumVars();
+	std::vector<int32_t> Rows(size_t(NumRows) * NumVars);
+	std::mt19937 Rng(42);
+	std::uniform_int_distribution<int32_t> Dist(0, 1000);
+	if (Distinct) {
+		// Tuple K is drawn with a probability proportional to 1/(K+1)
+		std::vector<int32_t> Tuples(size_t(Distinct) * NumVars);
+		for (int32_t &V : Tuples)
+			V = Dist(Rng);
+		std::vector<double> Weights(Distinct);
+		for (unsigned K = 0; K < Distinct; ++K)
+			Weights[K] = 1.0 / (K + 1);
+		std::discrete_distribution<unsigned> Pick(Weights.begin(),
+		                                          Weights.end());
+		for (size_t Row = 0; Row < NumRows; ++Row)
+			std::copy_n(&Tuples[size_t(Pick(Rng)) * NumVars], NumVars,
+			            &Rows[Row * NumVars]);
+	} else {
+		for (int32_t &V : Rows)
+			V = Dist(Rng);
+	}
+
+	std::vector<int32_t> Expected(NumRows), Results(NumRows);
+	unsigned Cores = MaxThreads ? unsigned(MaxThreads)
+	                            : llvm::hardware_concurrency().compute_thread_count();
+
+	double SerialTime = 0;
+	for (unsigned Threads = 1;; Threads = std::min(Threads * 2, Cores)) {
+		calc::Evaluator Eval(Threads);
+		llvm::MutableArrayRef<int32_t> Out =
+			Threads == 1 ? llvm::MutableArrayRef<int32_t>(Expected)
+			             : llvm::MutableArrayRef<int32_t>(Results);
+		double Time = measure(Eval, *E, Rows, Out);
+		if (Threads == 1)
+			SerialTime = Time;
+		else if (Results != Expected) {
+			llvm::errs() << Threads << " threads: results differ\n";
+			return 1;
+		}
+		double RowsPerSec = double(NumRows) * Iterations / Time;
+		llvm::outs() << llvm::format("%3u threads %10.2f Mrows/s   speedup %6.2fx\n",
+		                             Eval.getNumThreads(), RowsPerSec / 1e6,
+		                             SerialTime / Time);
+		if (Threads >= Cores)
+			break;
+	}
+
+	if (!Distinct)
+		return 0;
+	// Every run starts with an empty table, so that it doesn't profit
+	// from the tuples of the runs before. The statistics are the ones
+	// of the last run
+	calc::Memoizer Memo(*E, MemoCapacity);
+	std::chrono::duration<double> Elapsed(0);
+	for (unsigned I = 0; I < Iterations; ++I) {
+		Memo.clear();
+		auto Start = std::chrono::steady_clock::now();
+		Memo.run(Rows, Results);
+		Elapsed += std::chrono::steady_clock::now() - Start;
+	}
+	if (Results != Expected) {
+		llvm::errs() << "memoized: results differ\n";
+		return 1;
+	}
+	const calc::Memoizer::Stats &Stats = Memo.getStats();
+	llvm::outs() << llvm::format("  memoized %10.2f Mrows/s   speedup %6.2fx   "
+	                             "hit rate %5.1f%%   %llu evictions\n",
+	                             double(NumRows) * Iterations /
+	                                 Elapsed.count() / 1e6,
+	                             SerialTime / Elapsed.count(),
+	                             Stats.hitRate() * 100,
+	                             (unsigned long long)Stats.Evictions);
+	return 0;
+}
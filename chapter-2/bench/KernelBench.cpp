@@ -0,0 +1,146 @@
+// Compares evaluating many expressions over the same inputs one by
+// one with evaluating them as one kernel (see `calc::compileKernel()`).
+// The expressions are sums of subexpressions drawn from a common
+// pool, so the kernel computes every pooled subexpression only once
+// per row. The results of both ways must be identical.
+
+#include "LibCalc.hpp"
+#include "Measure.hpp"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static llvm::cl::opt<unsigned>
+	NumExprs("exprs", llvm::cl::desc("Number of expressions"),
+			 llvm::cl::init(32));
+
+static llvm::cl::opt<unsigned>
+	NumVars("vars", llvm::cl::desc("Number of variables"),
+			llvm::cl::init(8));
+
+static llvm::cl::opt<unsigned>
+	PoolSize("pool", llvm::cl::desc("Number of shared subexpressions"),
+			 llvm::cl::init(16));
+
+static llvm::cl::opt<unsigned>
+	NumRows("rows", llvm::cl::desc("Number of input rows"),
+			llvm::cl::init(1 << 20));
+
+namespace {
+// Identifiers consist of letters only, so the variables are named
+// va, vb, ..., vz, vba, ...
+std::string getVarName(unsigned I) {
+    std::string Name;
+    do {
+        Name.insert(Name.begin(), char('a' + I % 26));
+        I /= 26;
+    } while (I);
+    return "v" + Name;
+}
+
+// Every expression declares all variables, so both ways read the
+// same rows
+std::vector<std::string> generateExprs(std::mt19937 &Gen) {
+    std::uniform_int_distribution<unsigned> Var(0, NumVars - 1);
+    auto V = [&] { return getVarName(Var(Gen)); };
+    std::vector<std::string> Pool;
+    for (unsigned I = 0; I < PoolSize; ++I) {
+        std::string A = V(), B = V(), C = V(), D = V();
+        Pool.push_back("(" + A + "+" + B + ")*(" + C + "-" + D + ")/(" +
+                       A + "*" + A + "+1)");
+    }
+
+    std::string With = "with " + getVarName(0);
+    for (unsigned I = 1; I < NumVars; ++I)
+        With += "," + getVarName(I);
+    With += ": ";
+    std::uniform_int_distribution<unsigned> Pick(0, PoolSize - 1);
+    std::vector<std::string> Exprs;
+    for (unsigned I = 0; I < NumExprs; ++I)
+        Exprs.push_back(With + Pool[Pick(Gen)] + "+" + Pool[Pick(Gen)] + "*" +
+                        Pool[Pick(Gen)] + "-" + V() + "*" + std::to_string(I));
+    return Exprs;
+}
+} // namespace
+
+int main(int argc, const char **argv) {
+	llvm::InitLLVM X(argc, argv);
+	llvm::cl::ParseCommandLineOptions(
+		argc, argv, "calc-kernel-bench - separate expressions vs. one kernel\n");
+	if (NumExprs == 0 || NumVars == 0 || PoolSize == 0) {
+		llvm::errs() << "-exprs, -vars and -pool must be positive\n";
+		return 1;
+	}
+
+	std::mt19937 Gen(42);
+	std::vector<std::string> Texts = generateExprs(Gen);
+	std::vector<llvm::StringRef> Exprs(Texts.begin(), Texts.end());
+
+	std::vector<calc::CompiledExpr> Separate;
+	double SeparateCompile = measure([&] {
+		for (llvm::StringRef Expr : Exprs) {
+			llvm::Expected<calc::CompiledExpr> E = calc::compile(Expr);
+			if (!E) {
+				llvm::errs() << llvm::toString(E.takeError()) << "\n";
+				exit(1);
+			}
+			Separate.push_back(*E);
+		}
+	});
+	calc::CompiledKernel Kernel;
+	double KernelCompile = measure([&] {
+		llvm::Expected<calc::CompiledKernel> K = calc::compileKernel(Exprs);
+		if (!K) {
+			llvm::errs() << llvm::toString(K.takeError()) << "\n";
+			exit(1);
+		}
+		Kernel = *K;
+	});
+	if (Kernel.getNumInputs() != NumVars) {
+		llvm::errs() << "Unexpected number of kernel inputs\n";
+		return 1;
+	}
+
+	// Small values, so that no intermediate result overflows
+	std::uniform_int_distribution<int32_t> Dist(-1000, 1000);
+	std::vector<int32_t> Rows(size_t(NumRows) * NumVars);
+	for (int32_t &V : Rows)
+		V = Dist(Gen);
+	std::vector<int32_t> Reference(size_t(NumRows) * NumExprs);
+	std::vector<int32_t> Results(size_t(NumRows) * NumExprs);
+
+	double SeparateTime = measure([&] {
+		for (size_t R = 0; R < NumRows; ++R)
+			for (unsigned E = 0; E < NumExprs; ++E)
+				Reference[R * NumExprs + E] = Separate[E](&Rows[R * NumVars]);
+	});
+	double KernelTime = measure([&] {
+		for (size_t R = 0; R < NumRows; ++R)
+			Kernel(&Rows[R * NumVars], &Results[R * NumExprs]);
+	});
+	if (Results != Reference) {
+		llvm::errs() << "The kernel computed different results\n";
+		return 1;
+	}
+
+	llvm::outs() << llvm::format("%u expressions, %u variables, %u shared "
+								 "subexpressions, %u rows\n",
+								 unsigned(NumExprs), unsigned(NumVars),
+								 unsigned(PoolSize), unsigned(NumRows));
+	llvm::outs() << llvm::format("separate: compile %8.2f ms, %7.1f ns/row\n",
+								 SeparateCompile * 1e3,
+								 SeparateTime * 1e9 / NumRows);
+	llvm::outs() << llvm::format("kernel:   compile %8.2f ms, %7.1f ns/row "
+								 "(%.2fx)\n",
+								 KernelCompile * 1e3, KernelTime * 1e9 / NumRows,
+								 SeparateTime / KernelTime);
+	return 0;
+}
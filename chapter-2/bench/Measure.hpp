@@ -0,0 +1,17 @@
+#ifndef MEASURE_H
+#define MEASURE_H
+
+#include <chrono>
+
+// Returns the wall clock time in seconds of calling Run Iterations
+// times
+template <typename Fn> double measure(Fn &&Run, unsigned Iterations = 1) {
+    auto Start = std::chrono::steady_clock::now();
+    for (unsigned I = 0; I < Iterations; ++I)
+        Run();
+    std::chrono::duration<double> Elapsed =
+        std::chrono::steady_clock::now() - Start;
+    return Elapsed.count();
+}
+
+#endif
@@ -0,0 +1,117 @@
+// Compares parsing with the lexer called by the parser against
+// parsing with the lexer on its own thread (`ThreadedLexer`). A long
+// expression is generated, parsed both ways, and the two trees are
+// compared through a checksum. The threaded pipeline can at best
+// hide the time of the lexer behind the parser, so the speedup is
+// bounded by (lexer + parser) / max(lexer, parser), and needs a
+// spare core to show at all.
+
+#include "Parser.hpp"
+#include "RecursiveASTVisitor.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+static llvm::cl::opt<unsigned>
+	NumLeaves("leaves", llvm::cl::desc("Number of leaves of the expression"),
+			  llvm::cl::init(1 << 21));
+
+static llvm::cl::opt<unsigned>
+	Iterations("iterations", llvm::cl::desc("Parses per measurement"),
+			   llvm::cl::init(5));
+
+namespace {
+class Checksum : public RecursiveASTVisitor<Checksum> {
+public:
+    uint64_t Sum = 0;
+
+    void visitFactor(Factor &Node) {
+        Sum = Sum * 31 + Node.getIntVal() + Node.getVal().size();
+    }
+    void visitBinaryOp(BinaryOp &Node) {
+        Sum = Sum * 31 + Node.getOperator() + 1;
+    }
+};
+
+// A left-deep chain mixing the two precedence levels, with a mix
+// of variables and literals of several lengths
+std::string generate(unsigned Leaves) {
+    static const char Ops[] = {'+', '-', '*', '/'};
+    std::string Out = "with a, bc, def: ";
+    for (unsigned I = 0; I < Leaves; ++I) {
+        if (I)
+            Out += Ops[I % 4];
+        switch (I % 5) {
+        case 0: Out += "a"; break;
+        case 1: Out += "bc"; break;
+        case 2: Out += "def"; break;
+        default: Out += std::to_string(1 + I % 9973); break;
+        }
+    }
+    return Out;
+}
+
+struct Result {
+    double Seconds = 0;
+    uint64_t Sum = 0;
+};
+
+// The trees are deliberately leaked, like in the driver; their
+// deallocation would only add noise
+Result run(const std::string &Text, bool Threaded) {
+    Result R;
+    auto Start = std::chrono::steady_clock::now();
+    for (unsigned I = 0; I < Iterations; ++I) {
+        Lexer Lex(Text);
+        Parser Parser(Lex, Threaded);
+        AST *Tree = Parser.parse();
+        if (!Tree || Parser.hasError()) {
+            llvm::errs() << "Syntax errors occured\n";
+            exit(1);
+        }
+        Checksum C;
+        C.traverse(Tree);
+        R.Sum = C.Sum;
+    }
+    std::chrono::duration<double> Elapsed =
+        std::chrono::steady_clock::now() - Start;
+    R.Seconds = Elapsed.count();
+    return R;
+}
+} // namespace
+
+int main(int argc, const char **argv) {
+	llvm::InitLLVM X(argc, argv);
+	llvm::cl::ParseCommandLineOptions(
+		argc, argv, "calc-pipeline-bench - threaded lexer throughput\n");
+	if (NumLeaves == 0 || Iterations == 0) {
+		llvm::errs() << "-leaves and -iterations must be positive\n";
+		return 1;
+	}
+
+	std::string Text = generate(NumLeaves);
+	double MiB = Text.size() * double(Iterations) / (1 << 20);
+	Result Sync = run(Text, /*Threaded=*/false);
+	Result Piped = run(Text, /*Threaded=*/true);
+	if (Sync.Sum != Piped.Sum) {
+		llvm::errs() << "The threaded lexer produced a different tree\n";
+		return 1;
+	}
+
+	llvm::outs() << llvm::format("input %.1f MiB, %u cores\n",
+								 Text.size() / double(1 << 20),
+								 std::thread::hardware_concurrency());
+	llvm::outs() << llvm::format("synchronous %8.1f MiB/s\n",
+								 MiB / Sync.Seconds);
+	llvm::outs() << llvm::format("threaded    %8.1f MiB/s   speedup %.2fx\n",
+								 MiB / Piped.Seconds,
+								 Sync.Seconds / Piped.Seconds);
+	return 0;
+}
@@ -0,0 +1,136 @@
+// Microbenchmark for AST traversal. The same checksum is computed
+// over large trees twice, both times in the post-order the code
+// generator needs: once through the virtual `ASTVisitor` (`accept()`
+// plus `visit()`, driven by a worklist like `ToIRVisitor` used to
+// be) and once through the statically dispatched
+// `RecursiveASTVisitor`.
+
+#include "AST.h"
+#include "Measure.hpp"
+#include "RecursiveASTVisitor.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+
+static llvm::cl::opt<unsigned>
+	NumNodes("nodes", llvm::cl::desc("Number of leaves per tree"),
+			 llvm::cl::init(1 << 20));
+
+static llvm::cl::opt<unsigned>
+	Iterations("iterations", llvm::cl::desc("Traversals per measurement"),
+			   llvm::cl::init(20));
+
+namespace {
+class VirtualChecksum : public ASTVisitor {
+    // An entry with the flag set is a `BinaryOp` whose
+    // operands have already been visited
+    llvm::SmallVector<llvm::PointerIntPair<AST *, 1, bool>, 32> Worklist;
+public:
+    uint64_t Sum = 0;
+
+    void run(AST *Tree) {
+        Worklist.push_back({Tree, false});
+        while (!Worklist.empty()) {
+            auto Item = Worklist.pop_back_val();
+            if (Item.getInt())
+                Sum += static_cast<BinaryOp *>(Item.getPointer())
+                           -> getOperator() + 1;
+            else
+                Item.getPointer() -> accept(*this);
+        }
+    }
+
+    virtual void visit(Factor &Node) override {
+        Sum += Node.getVal().size();
+    }
+
+    virtual void visit(BinaryOp &Node) override {
+        Worklist.push_back({&Node, true});
+        Worklist.push_back({Node.getRight(), false});
+        Worklist.push_back({Node.getLeft(), false});
+    }
+
+    virtual void visit(WithDecl &Node) override {
+        Worklist.push_back({Node.getExpr(), false});
+    }
+};
+
+class StaticChecksum : public RecursiveASTVisitor<StaticChecksum> {
+public:
+    uint64_t Sum = 0;
+
+    void visitFactor(Factor &Node) { Sum += Node.getVal().size(); }
+    void visitBinaryOp(BinaryOp &Node) { Sum += Node.getOperator() + 1; }
+};
+
+BinaryOp::Operator opFor(unsigned I) {
+    return static_cast<BinaryOp::Operator>(I % 4);
+}
+
+// Leaves alternate between identifiers and numbers
+Expr *leaf(unsigned I) {
+    return I % 2 ? new Factor(Factor::Ident, "abc")
+                 : new Factor(Factor::Number, "42");
+}
+
+Expr *buildBalanced(unsigned First, unsigned Count) {
+    if (Count == 1)
+        return leaf(First);
+    unsigned Half = Count / 2;
+    return new BinaryOp(opFor(First + Half), buildBalanced(First, Half),
+                        buildBalanced(First + Half, Count - Half));
+}
+
+Expr *buildLeftDeep(unsigned Count) {
+    Expr *E = leaf(0);
+    for (unsigned I = 1; I < Count; ++I)
+        E = new BinaryOp(opFor(I), E, leaf(I));
+    return E;
+}
+
+void bench(llvm::StringRef Shape, Expr *Tree) {
+    // Leaves plus inner nodes
+    double Visits = (2.0 * NumNodes - 1) * Iterations;
+
+    uint64_t VirtualSum = 0, StaticSum = 0;
+    double VirtualTime = measure([&] {
+        VirtualChecksum V;
+        V.run(Tree);
+        VirtualSum += V.Sum;
+    }, Iterations);
+    double StaticTime = measure([&] {
+        StaticChecksum V;
+        V.traverse(Tree);
+        StaticSum += V.Sum;
+    }, Iterations);
+
+    if (VirtualSum != StaticSum) {
+        llvm::errs() << Shape << ": checksums differ\n";
+        exit(1);
+    }
+    llvm::outs() << llvm::format("%-10s virtual %8.2f Mnodes/s   static %8.2f "
+                                 "Mnodes/s   speedup %.2fx\n",
+                                 Shape.str().c_str(),
+                                 Visits / VirtualTime / 1e6,
+                                 Visits / StaticTime / 1e6,
+                                 VirtualTime / StaticTime);
+}
+} // namespace
+
+int main(int argc, const char **argv) {
+	llvm::InitLLVM X(argc, argv);
+	llvm::cl::ParseCommandLineOptions(
+		argc, argv, "calc-visitor-bench - AST traversal throughput\n");
+	if (NumNodes == 0) {
+		llvm::errs() << "-nodes must be positive\n";
+		return 1;
+	}
+
+	bench("balanced", buildBalanced(0, NumNodes));
+	bench("left-deep", buildLeftDeep(NumNodes));
+	return 0;
+}
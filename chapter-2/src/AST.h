@@ -3,6 +3,9 @@
 
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Casting.h"
+
+#include <cstdint>
 
 class AST;
 class Expr;
@@ -23,15 +26,31 @@ public:
   virtual void visit(WithDecl &) = 0;
 };
 
+// Besides the virtual `accept()`, every node carries a kind
+// discriminator. Together with the `classof()` methods below this
+// makes the classes usable with LLVM's `isa<>`, `cast<>` and
+// `dyn_cast<>`, and lets `RecursiveASTVisitor` dispatch statically
 class AST {
+public:
+    enum NodeKind { NK_WithDecl, NK_Factor, NK_BinaryOp };
+private:
+    const NodeKind Kind;
+protected:
+    AST(NodeKind Kind) : Kind(Kind) {}
 public:
     virtual ~AST() {}
+    NodeKind getNodeKind() const { return Kind; }
     virtual void accept(ASTVisitor &V) = 0;
 };
 
 class Expr : public AST {
+protected:
+    Expr(NodeKind Kind) : AST(Kind) {}
 public:
-    Expr() {}
+    static bool classof(const AST *Node) {
+        return Node->getNodeKind() >= NK_Factor &&
+               Node->getNodeKind() <= NK_BinaryOp;
+    }
 };
 
 class Factor : public Expr {
@@ -44,13 +63,19 @@ public:
 private:
     ValueKind Kind;
     llvm::StringRef Val;
+    int32_t IntVal; // Value of a number, as converted by the lexer
 public:
-    Factor(ValueKind Kind, llvm::StringRef Val) : Kind(Kind), Val(Val) {}
+    Factor(ValueKind Kind, llvm::StringRef Val, int32_t IntVal = 0)
+        : Expr(NK_Factor), Kind(Kind), Val(Val), IntVal(IntVal) {}
     ValueKind getKind() { return Kind; }
     llvm::StringRef getVal() { return Val; }
+    int32_t getIntVal() { return IntVal; }
     virtual void accept(ASTVisitor &V) override {
         V.visit(*this);
     }
+    static bool classof(const AST *Node) {
+        return Node->getNodeKind() == NK_Factor;
+    }
 };
 
 class BinaryOp : public Expr {
@@ -66,13 +91,16 @@ private:
     Operator Op;
 public:
     BinaryOp(Operator Op, Expr *L, Expr *R)
-        : Op(Op), Left(L), Right(R) {}
+        : Expr(NK_BinaryOp), Op(Op), Left(L), Right(R) {}
     Expr *getLeft() { return Left; }
     Expr *getRight() { return Right; }
     Operator getOperator() { return Op; }
     virtual void accept(ASTVisitor &V) override {
         V.visit(*this);
     }
+    static bool classof(const AST *Node) {
+        return Node->getNodeKind() == NK_BinaryOp;
+    }
 };
 
 class WithDecl : public AST {
@@ -85,7 +113,7 @@ class WithDecl : public AST {
     Expr *E;
 public:
     WithDecl(llvm::SmallVector<llvm::StringRef, 8> Vars, Expr *E)
-        : Vars(Vars), E(E) {}
+        : AST(NK_WithDecl), Vars(Vars), E(E) {}
     VarVector::const_iterator begin() {
         return Vars.begin();
     }
@@ -96,6 +124,9 @@ public:
     virtual void accept(ASTVisitor &V) override {
         V.visit(*this);
     }
+    static bool classof(const AST *Node) {
+        return Node->getNodeKind() == NK_WithDecl;
+    }
 };
 
 #endif
\ No newline at end of file
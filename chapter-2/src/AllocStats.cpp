@@ -0,0 +1,259 @@
+#include "AllocStats.hpp"
+
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/Format.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#include <sys/mman.h>
+#endif
+
+using namespace allocstats;
+
+namespace {
+const char *const PhaseNames[] = {"driver", "lexer", "parser", "sema",
+                                  "codegen"};
+
+struct PhaseCounters {
+    std::atomic<uint64_t> Allocs{0};
+    std::atomic<uint64_t> Bytes{0};
+    std::atomic<int64_t> PeakLive{0};
+};
+
+// Everything here must be usable without allocating, and before any
+// constructor has run, so only constant initialized atomics are used
+std::atomic<bool> Enabled{false};
+// Set by the first enable(). From then on, releases are checked for
+// marks (see below) even while disabled, so no mark outlives its block
+std::atomic<bool> Tracking{false};
+std::atomic<int64_t> Live{0};
+PhaseCounters Counters[NumPhases];
+
+void raisePeak(std::atomic<int64_t> &Peak, int64_t Value) {
+    int64_t Old = Peak.load(std::memory_order_relaxed);
+    while (Old < Value &&
+           !Peak.compare_exchange_weak(Old, Value, std::memory_order_relaxed))
+        ;
+}
+
+#if defined(__GLIBC__)
+// Releasing a block allocated before enable() must not be subtracted
+// from the live bytes, so the counted blocks are marked, with one bit
+// per 16 bytes of address space (the alignment of glibc's blocks).
+// The bits are kept in leaves covering 64 MiB each, which are mapped
+// on first use with mmap(), as malloc() can't be used here
+constexpr unsigned GranuleBits = 4;
+constexpr unsigned LeafBits = 26;
+constexpr unsigned AddressBits = 47;
+constexpr size_t LeafBytes = (size_t(1) << (LeafBits - GranuleBits)) / 8;
+std::atomic<std::atomic<uint64_t> *> Leaves[size_t(1) << (AddressBits - LeafBits)];
+
+// Returns the leaf holding the bit of Addr, or null if there is none
+// and Create is false, Addr is out of range or mapping failed
+std::atomic<uint64_t> *getLeaf(uintptr_t Addr, bool Create) {
+    if (Addr >> AddressBits)
+        return nullptr;
+    std::atomic<std::atomic<uint64_t> *> &Slot = Leaves[Addr >> LeafBits];
+    std::atomic<uint64_t> *Leaf = Slot.load(std::memory_order_acquire);
+    if (Leaf || !Create)
+        return Leaf;
+    void *Mem = mmap(nullptr, LeafBytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (Mem == MAP_FAILED)
+        return nullptr;
+    auto *New = static_cast<std::atomic<uint64_t> *>(Mem);
+    // Another thread may have mapped the leaf in the meantime
+    if (!Slot.compare_exchange_strong(Leaf, New, std::memory_order_acq_rel)) {
+        munmap(Mem, LeafBytes);
+        return Leaf;
+    }
+    return New;
+}
+
+uint64_t getMask(uintptr_t Addr, size_t &Word) {
+    size_t Bit = (Addr & ((uintptr_t(1) << LeafBits) - 1)) >> GranuleBits;
+    Word = Bit / 64;
+    return uint64_t(1) << (Bit % 64);
+}
+
+// Marks the block at Ptr as counted. Returns false if it can't be
+// tracked, and so mustn't be counted either
+bool mark(void *Ptr) {
+    uintptr_t Addr = reinterpret_cast<uintptr_t>(Ptr);
+    std::atomic<uint64_t> *Leaf = getLeaf(Addr, /*Create=*/true);
+    if (!Leaf)
+        return false;
+    size_t Word;
+    uint64_t Mask = getMask(Addr, Word);
+    Leaf[Word].fetch_or(Mask, std::memory_order_relaxed);
+    return true;
+}
+
+// Removes the mark of the block at Ptr, before it is released, so
+// that a thread getting the same address can't lose its mark.
+// Returns whether the block was counted
+bool unmark(void *Ptr) {
+    uintptr_t Addr = reinterpret_cast<uintptr_t>(Ptr);
+    std::atomic<uint64_t> *Leaf = getLeaf(Addr, /*Create=*/false);
+    if (!Leaf)
+        return false;
+    size_t Word;
+    uint64_t Mask = getMask(Addr, Word);
+    return Leaf[Word].fetch_and(~Mask, std::memory_order_relaxed) & Mask;
+}
+
+// The sizes are taken from the allocator, so that an allocation and
+// its release always account for the same number of bytes
+void recordAlloc(void *Ptr) {
+    if (!Ptr || !mark(Ptr))
+        return;
+    int64_t Size = malloc_usable_size(Ptr);
+    PhaseCounters &C = Counters[CurrentPhase];
+    C.Allocs.fetch_add(1, std::memory_order_relaxed);
+    C.Bytes.fetch_add(Size, std::memory_order_relaxed);
+    int64_t Now = Live.fetch_add(Size, std::memory_order_relaxed) + Size;
+    raisePeak(C.PeakLive, Now);
+}
+
+void recordFree(void *Ptr) {
+    if (Ptr && unmark(Ptr))
+        Live.fetch_sub(malloc_usable_size(Ptr), std::memory_order_relaxed);
+}
+
+bool isEnabled() {
+    return LLVM_UNLIKELY(Enabled.load(std::memory_order_relaxed));
+}
+
+bool isTracking() {
+    return LLVM_UNLIKELY(Tracking.load(std::memory_order_relaxed));
+}
+#endif
+} // namespace
+
+#if defined(__GLIBC__)
+// glibc explicitly supports replacing malloc() and friends. The
+// replacements forward to the real implementation.
+extern "C" {
+void *__libc_malloc(size_t Size);
+void *__libc_calloc(size_t Num, size_t Size);
+void *__libc_realloc(void *Ptr, size_t Size);
+void *__libc_memalign(size_t Alignment, size_t Size);
+void *__libc_valloc(size_t Size);
+void *__libc_pvalloc(size_t Size);
+void __libc_free(void *Ptr);
+
+void *malloc(size_t Size) {
+    void *Ptr = __libc_malloc(Size);
+    if (isEnabled())
+        recordAlloc(Ptr);
+    return Ptr;
+}
+
+void *calloc(size_t Num, size_t Size) {
+    void *Ptr = __libc_calloc(Num, Size);
+    if (isEnabled())
+        recordAlloc(Ptr);
+    return Ptr;
+}
+
+void *realloc(void *Ptr, size_t Size) {
+    if (!isTracking())
+        return __libc_realloc(Ptr, Size);
+    int64_t OldSize = Ptr ? malloc_usable_size(Ptr) : 0;
+    bool WasCounted = Ptr && unmark(Ptr);
+    void *NewPtr = __libc_realloc(Ptr, Size);
+    // On failure the old block is still valid
+    if (!NewPtr && Size) {
+        if (WasCounted)
+            mark(Ptr);
+        return nullptr;
+    }
+    if (WasCounted)
+        Live.fetch_sub(OldSize, std::memory_order_relaxed);
+    if (isEnabled())
+        recordAlloc(NewPtr);
+    return NewPtr;
+}
+
+// glibc's own reallocarray() wouldn't call the realloc() above
+void *reallocarray(void *Ptr, size_t Num, size_t Size) {
+    size_t Bytes;
+    if (__builtin_mul_overflow(Num, Size, &Bytes)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return realloc(Ptr, Bytes);
+}
+
+void *memalign(size_t Alignment, size_t Size) {
+    void *Ptr = __libc_memalign(Alignment, Size);
+    if (isEnabled())
+        recordAlloc(Ptr);
+    return Ptr;
+}
+
+void *aligned_alloc(size_t Alignment, size_t Size) {
+    return memalign(Alignment, Size);
+}
+
+void *valloc(size_t Size) {
+    void *Ptr = __libc_valloc(Size);
+    if (isEnabled())
+        recordAlloc(Ptr);
+    return Ptr;
+}
+
+void *pvalloc(size_t Size) {
+    void *Ptr = __libc_pvalloc(Size);
+    if (isEnabled())
+        recordAlloc(Ptr);
+    return Ptr;
+}
+
+int posix_memalign(void **Result, size_t Alignment, size_t Size) {
+    void *Ptr = memalign(Alignment, Size);
+    if (!Ptr && Size)
+        return ENOMEM;
+    *Result = Ptr;
+    return 0;
+}
+
+void free(void *Ptr) {
+    if (isTracking())
+        recordFree(Ptr);
+    __libc_free(Ptr);
+}
+}
+#endif
+
+bool allocstats::isSupported() {
+#if defined(__GLIBC__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void allocstats::enable() {
+    Tracking.store(true);
+    Enabled.store(true);
+}
+
+void allocstats::disable() { Enabled.store(false); }
+
+void allocstats::print(llvm::raw_ostream &OS) {
+    disable();
+    OS << llvm::format("%-10s %12s %16s %16s\n", (const char *)"phase",
+                       (const char *)"allocations", (const char *)"bytes",
+                       (const char *)"peak live bytes");
+    for (unsigned P = 0; P < NumPhases; ++P)
+        OS << llvm::format("%-10s %12llu %16llu %16lld\n", PhaseNames[P],
+                           (unsigned long long)Counters[P].Allocs.load(),
+                           (unsigned long long)Counters[P].Bytes.load(),
+                           (long long)Counters[P].PeakLive.load());
+}
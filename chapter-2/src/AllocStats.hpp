@@ -0,0 +1,53 @@
+#ifndef ALLOCSTATS_H
+#define ALLOCSTATS_H
+
+#include "llvm/Support/raw_ostream.h"
+
+// Allocation accounting for `--alloc-stats`. When enabled, every call
+// to malloc(), calloc(), realloc() and the aligned variants - and
+// therefore also every `new` and every SmallVector or StringMap growth
+// - is counted and attributed to the compiler phase the allocating
+// thread is in. For each phase the number of allocations, the
+// allocated bytes and the peak of the live heap bytes are reported.
+// Releasing blocks allocated before enable() isn't accounted.
+//
+// This works by replacing the allocator entry points of the C library,
+// which is only implemented for glibc. Any program AllocStats.cpp is
+// linked into gets the replacements, so it is only part of the calc
+// driver, not of calcCompiler or libcalc (see src/CMakeLists.txt).
+// The phases are marked with the inline functions below, which don't
+// need it. While disabled, the overhead is a single check of a flag
+// per allocation.
+namespace allocstats {
+
+enum Phase { Driver, Lexer, Parser, Sema, CodeGen, NumPhases };
+
+// The phase allocations of the current thread are attributed to. It
+// is defined here, so that marking phases doesn't pull in the rest
+inline thread_local Phase CurrentPhase = Driver;
+
+// Returns false if allocations can't be intercepted on this platform
+bool isSupported();
+
+void enable();
+void disable();
+
+// Prints a table of the statistics, disabling the accounting first
+void print(llvm::raw_ostream &OS);
+
+// Attributes the allocations of the current thread to `P`, until the
+// next call. Used by drivers running the phases one after the other
+inline void setPhase(Phase P) { CurrentPhase = P; }
+
+// Attributes the allocations of the current thread to `P` while the
+// scope is active, e.g. the lexer called from within the parser
+class Scope {
+    Phase Saved;
+public:
+    explicit Scope(Phase P) : Saved(CurrentPhase) { CurrentPhase = P; }
+    ~Scope() { CurrentPhase = Saved; }
+};
+
+} // namespace allocstats
+
+#endif
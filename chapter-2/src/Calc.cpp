@@ -4,12 +4,19 @@
 // phases from the previous sections are called:
 
 // First we include the required header files
+#include "AllocStats.hpp"
 #include "CodeGen.hpp"
+#include "ObjectEmitter.hpp"
 #include "Parser.hpp"
+#include "RecursiveASTVisitor.h"
+#include "Runtime.hpp"
 #include "Sema.hpp"
 
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/ScopeExit.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 
 // LLVM comes with its own system for declaring command-line
@@ -18,28 +25,319 @@
 // a global command line parser. The advantage of this approach
 // is that each component can add command-line options when needed.
 
-// We declare an option for the input expression
-static llvm::cl::opt<std::string>
+// We declare an option for the input expression. A single `-`
+// reads the expression from standard input instead. Only
+// --syntax-only and --check-only take more than one
+static llvm::cl::list<std::string>
 	Input(llvm::cl::Positional,
-		  llvm::cl::desc("<input expression>"),
-		  llvm::cl::init(""));
+		  llvm::cl::desc("<input expression>..."));
+
+// Large expressions don't fit on the command line, so they can
+// also be read from a file
+static llvm::cl::opt<std::string>
+	InputFile("f",
+			  llvm::cl::desc("Read the input expression from <file>"),
+			  llvm::cl::value_desc("file"));
+
+// Variables whose value is known at compile time. Each occurrence
+// has the form `name=value`
+static llvm::cl::list<std::string>
+	Bindings("bind",
+			 llvm::cl::desc("Bind variable <name> to the constant <value>"),
+			 llvm::cl::value_desc("name=value"));
+
+// Lexes on a separate thread, overlapping with the parser. This
+// pays off for large inputs on machines with a spare core
+static llvm::cl::opt<bool>
+	ThreadedLexer("threaded-lexer",
+				  llvm::cl::desc("Run the lexer on its own thread"));
+
+// Generates the IR while parsing, without an AST in between
+static llvm::cl::opt<bool>
+	Stream("stream",
+		   llvm::cl::desc("Generate code while parsing, without building "
+						  "an AST"));
+
+// By default, the IR is printed for `llc`. With -o, the compiler
+// generates the object file itself, using all cores for large inputs
+static llvm::cl::opt<std::string>
+	OutputFile("o",
+			   llvm::cl::desc("Write an object file to <file> instead of "
+							  "printing the IR"),
+			   llvm::cl::value_desc("file"));
+
+static llvm::cl::opt<unsigned>
+	CodeGenThreads("codegen-threads",
+				   llvm::cl::desc("Threads generating the object file "
+								  "(default: all cores)"),
+				   llvm::cl::init(0));
+
+// Huge expressions are split into functions (see CodeGen.hpp). Parts
+// of a few thousand nodes compiled fastest for an expression with
+// millions of operations: smaller ones pay for the calls and the
+// spilled variables, larger ones for the backend's superlinear parts
+static llvm::cl::opt<unsigned>
+	MaxFunctionSize("max-function-size",
+					llvm::cl::desc("Split subexpressions of more than <n> "
+								   "nodes into functions (0: never)"),
+					llvm::cl::value_desc("n"), llvm::cl::init(4096));
+
+// Links the runtime into the generated code and optimizes it, so
+// the calls of the runtime functions are inlined. The output then
+// doesn't need to be linked with rtcalc.c, and has the same batch
+// mode
+static llvm::cl::opt<bool>
+	InlineRuntime("inline-runtime",
+				  llvm::cl::desc("Link the runtime into the generated code "
+								 "and optimize it"));
+
+// Only check the input, without generating code. Every argument is
+// an expression of its own, and a status line is printed for each
+// (see check()). A file or standard input is one expression, like
+// when compiling it, unless --lines is given
+static llvm::cl::opt<bool>
+	SyntaxOnly("syntax-only",
+			   llvm::cl::desc("Only check the syntax of the expressions"));
+
+static llvm::cl::opt<bool>
+	CheckOnly("check-only",
+			  llvm::cl::desc("Only check the syntax and the semantics of "
+							 "the expressions"));
+
+// With --syntax-only and --check-only, every line of a file or of
+// standard input is checked as an expression of its own
+static llvm::cl::opt<bool>
+	Lines("lines",
+		  llvm::cl::desc("Check every line of the input as an expression "
+						 "of its own"));
+
+// Counts the allocations done by each phase of the compiler
+static llvm::cl::opt<bool>
+	AllocStats("alloc-stats",
+			   llvm::cl::desc("Print allocation statistics per compiler phase"));
+
+// Parses a binding of the form `name=value`
+static bool parseBinding(llvm::StringRef Binding, llvm::StringRef &Name,
+						 int32_t &Value) {
+	llvm::StringRef Text;
+	std::tie(Name, Text) = Binding.split('=');
+	if (Text.getAsInteger(10, Value)) {
+		llvm::errs() << "Invalid binding " << Binding
+					 << ", expected name=value\n";
+		return false;
+	}
+	return true;
+}
+
+// Returns the buffer holding the expression. Files are memory mapped
+// if possible, and the buffer is always null terminated, as the
+// lexer requires. Tokens and AST nodes point directly into it, so it
+// must outlive the code generation
+static std::unique_ptr<llvm::MemoryBuffer> getInputBuffer(llvm::StringRef Expr) {
+	if (InputFile.empty() && Expr != "-")
+		return llvm::MemoryBuffer::getMemBuffer(Expr, "<input expression>");
+
+	llvm::StringRef FileName =
+		InputFile.empty() ? llvm::StringRef("-") : InputFile.getValue();
+	llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> BufferOrErr =
+		llvm::MemoryBuffer::getFileOrSTDIN(FileName);
+	if (std::error_code EC = BufferOrErr.getError()) {
+		llvm::errs() << "Cannot read " << FileName << ": "
+					 << EC.message() << "\n";
+		return nullptr;
+	}
+	return std::move(*BufferOrErr);
+}
+
+namespace {
+// The parser actions of --syntax-only, which build nothing. Any
+// non-null handle marks an expression without syntax errors
+class SyntaxCheck : public ParserActions {
+public:
+	ExprHandle actOnNumber(llvm::StringRef, int32_t) override { return this; }
+	ExprHandle actOnIdent(llvm::StringRef) override { return this; }
+	ExprHandle actOnBinaryOp(BinaryOp::Operator, ExprHandle Left,
+							 ExprHandle Right) override {
+		return Left && Right ? this : nullptr;
+	}
+	void actOnCalc(ExprHandle E) override { Valid = E != nullptr; }
+
+	bool Valid = false;
+};
+} // namespace
+
+// Checks a single expression, which must be null terminated, and
+// returns its status
+static llvm::StringRef checkExpr(llvm::StringRef Expr) {
+	Lexer Lex(Expr);
+	Parser Parser(Lex);
+	if (SyntaxOnly) {
+		SyntaxCheck Check;
+		Parser.parse(Check);
+		return Check.Valid && !Parser.hasError() ? "ok" : "syntax error";
+	}
+
+	AST *Tree = Parser.parse();
+	if (!Tree || Parser.hasError())
+		return "syntax error";
+	bool HasError = Sema().semantic(Tree);
+	TreeDeleter().traverse(Tree);
+	return HasError ? "semantic error" : "ok";
+}
+
+// Implements --syntax-only and --check-only. Every expression gets a
+// line `<n>: <status>` on standard output, where n is the number of
+// the argument (or of the line in the input with --lines, else 1),
+// and the status is `ok`, `syntax error` or `semantic error`. The
+// messages of the parser and of the semantic analysis go to standard
+// error as usual. Blank expressions are skipped. Nothing of the code
+// generator is initialized, so this runs before InitLLVM. Returns
+// the exit code, 1 if any expression has errors or if there is no
+// input at all
+static int check() {
+	bool HasError = false;
+	std::string Line;
+	auto CheckExpr = [&](unsigned Number, llvm::StringRef Expr) {
+		if (Expr.trim().empty())
+			return;
+		// The lexer needs a null terminated string
+		Line.assign(Expr.begin(), Expr.end());
+		llvm::StringRef Status = checkExpr(Line);
+		HasError |= Status != "ok";
+		llvm::outs() << Number << ": " << Status << "\n";
+	};
+
+	bool FromBuffer =
+		!InputFile.empty() || (Input.size() == 1 && Input[0] == "-");
+	if (!FromBuffer && Input.empty()) {
+		llvm::errs() << "Nothing to check; give expressions, -f <file> or -\n";
+		return 1;
+	}
+	if (Lines && !FromBuffer) {
+		llvm::errs() << "--lines needs -f <file> or - as input\n";
+		return 1;
+	}
+
+	if (!FromBuffer) {
+		for (unsigned I = 0, E = Input.size(); I != E; ++I)
+			CheckExpr(I + 1, Input[I]);
+		return HasError;
+	}
+
+	std::unique_ptr<llvm::MemoryBuffer> Buffer = getInputBuffer("-");
+	if (!Buffer)
+		return 1;
+	if (!Lines) {
+		CheckExpr(1, Buffer -> getBuffer());
+		return HasError;
+	}
+	unsigned Number = 0;
+	for (llvm::StringRef Rest = Buffer -> getBuffer(); !Rest.empty();) {
+		llvm::StringRef Expr;
+		std::tie(Expr, Rest) = Rest.split('\n');
+		CheckExpr(++Number, Expr);
+	}
+	return HasError;
+}
+
+// Writes the object file, or prints the IR. Returns the exit code
+static int emit(llvm::Module &M) {
+	if (InlineRuntime) {
+		if (llvm::Error Err = calc::linkRuntime(M)) {
+			llvm::errs() << llvm::toString(std::move(Err)) << "\n";
+			return 1;
+		}
+		calc::optimizeModule(M);
+	}
+	if (!OutputFile.empty()) {
+		if (llvm::Error Err = ObjectEmitter(CodeGenThreads).emit(M, OutputFile)) {
+			llvm::errs() << llvm::toString(std::move(Err)) << "\n";
+			return 1;
+		}
+		return 0;
+	}
+	allocstats::setPhase(allocstats::Driver);
+	M.print(llvm::outs(), nullptr);
+	return 0;
+}
 
 int main(int argc, const char **argv) {
 	// Inside the `main()` function, the LLVM libraries are initialized
 	// first. You need to call the `ParseCommandLineOptions()` function
 	// to handle the options given on the command line. This also handles
 	// the printing of help information. In the event of an error, this
-	// method exists the application:
+	// method exists the application. The options are parsed before
+	// InitLLVM, which --syntax-only and --check-only don't need:
 
-	llvm::InitLLVM X(argc, argv);
 	llvm::cl::ParseCommandLineOptions(
 		argc, argv, "calc - the expression compiler\n");
-	
+
+	if (AllocStats) {
+		if (!allocstats::isSupported())
+			llvm::errs() << "--alloc-stats is not supported on this platform\n";
+		allocstats::enable();
+	}
+	auto PrintAllocStats = llvm::make_scope_exit([] {
+		if (AllocStats)
+			allocstats::print(llvm::errs());
+	});
+
+	if (!InputFile.empty() && !Input.empty()) {
+		llvm::errs() << "Either give an expression or -f <file>, not both\n";
+		return 1;
+	}
+	if (SyntaxOnly && CheckOnly) {
+		llvm::errs() << "Either give --syntax-only or --check-only, not both\n";
+		return 1;
+	}
+	if (SyntaxOnly || CheckOnly)
+		return check();
+	if (Lines) {
+		llvm::errs() << "--lines needs --syntax-only or --check-only\n";
+		return 1;
+	}
+	if (Input.size() > 1) {
+		llvm::errs() << "Only --syntax-only and --check-only take more than "
+						"one expression\n";
+		return 1;
+	}
+
+	llvm::InitLLVM X(argc, argv);
+	std::unique_ptr<llvm::MemoryBuffer> Buffer =
+		getInputBuffer(Input.empty() ? llvm::StringRef("") : Input[0]);
+	if (!Buffer)
+		return 1;
+
 	// Next , we call the lexer and the parser. After the syntactical
 	// analysis, we check whether any errors occured. If this is the case,
 	// then we exit the compiler with a return code indicating a failure
-	Lexer Lex(Input);
-	Parser Parser(Lex);
+	allocstats::setPhase(allocstats::Parser);
+	Lexer Lex(Buffer -> getBuffer());
+	Parser Parser(Lex, ThreadedLexer);
+	CodeGen CodeGenerator;
+	CodeGenerator.setMaxFunctionSize(MaxFunctionSize);
+	llvm::LLVMContext Ctx;
+	std::unique_ptr<llvm::Module> M;
+
+	// In streaming mode, all phases run at once. The code generator
+	// checks the declarations and the bindings itself
+	if (Stream) {
+		for (llvm::StringRef Binding : Bindings) {
+			llvm::StringRef Name;
+			int32_t Value;
+			if (!parseBinding(Binding, Name, Value))
+				return 1;
+			CodeGenerator.bind(Name, Value);
+		}
+		allocstats::setPhase(allocstats::CodeGen);
+		M = CodeGenerator.generateStreaming(Parser, Ctx);
+		if (!M) {
+			llvm::errs() << "Errors occured\n";
+			return 1;
+		}
+		return emit(*M);
+	}
+
 	AST *Tree = Parser.parse();
 	if (!Tree || Parser.hasError()) {
 		llvm::errs() << "Syntax errors occured\n";
@@ -47,14 +345,28 @@ int main(int argc, const char **argv) {
 	}
 
 	// We do the same if there was a semantic error
+	allocstats::setPhase(allocstats::Sema);
 	Sema Semantic;
 	if (Semantic.semantic(Tree)) {
 		llvm::errs() << "Semantic errors occured\n";
 		return 1;
 	}
 
-	// As the last step in the driver, the code generator is called
-	CodeGen CodeGenerator;
-	CodeGenerator.compile(Tree);
-	return 0;
+	// As the last step in the driver, the code generator is called.
+	// Bindings must name a variable declared in the `with` list
+	auto *Decl = llvm::dyn_cast<WithDecl>(Tree);
+	for (llvm::StringRef Binding : Bindings) {
+		llvm::StringRef Name;
+		int32_t Value;
+		if (!parseBinding(Binding, Name, Value))
+			return 1;
+		if (!Decl || llvm::find(*Decl, Name) == Decl -> end()) {
+			llvm::errs() << "Bound variable " << Name << " not declared\n";
+			return 1;
+		}
+		CodeGenerator.bind(Name, Value);
+	}
+	allocstats::setPhase(allocstats::CodeGen);
+	M = CodeGenerator.generate(Tree, Ctx);
+	return emit(*M);
 }
\ No newline at end of file
@@ -1,21 +1,177 @@
 #include "CodeGen.hpp"
+#include "Parser.hpp"
+#include "RecursiveASTVisitor.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringMap.h"
+#include "llvm/Analysis/InstSimplifyFolder.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <tuple>
+
 using namespace llvm; // Namespace of the LLVM libraries is used for name lookups
 
 namespace {
-class ToIRVisitor : public ASTVisitor {
+// The builder used by both code generators. Its InstSimplifyFolder
+// folds constant operations, like the default folder, and also
+// simplifies operations with a constant operand such as `x * 0` or
+// `x + 0`. This matters when variables are bound to constants at
+// compile time
+using BuilderTy = IRBuilder<InstSimplifyFolder>;
+
+Value *emitBinaryOp(BuilderTy &Builder, BinaryOp::Operator Op, Value *Left,
+                    Value *Right) {
+    switch (Op) {
+    case BinaryOp::Plus:
+        return Builder.CreateNSWAdd(Left, Right);
+    case BinaryOp::Minus:
+        return Builder.CreateNSWSub(Left, Right);
+    case BinaryOp::Mul:
+        return Builder.CreateNSWMul(Left, Right);
+    case BinaryOp::Div:
+        return Builder.CreateSDiv(Left, Right);
+    }
+    llvm_unreachable("unknown binary operator");
+}
+
+// Emits a call of `calc_read()`, asking for the value of Var
+Value *emitCalcRead(Module *M, BuilderTy &Builder, StringRef Var) {
+    // `calc_read()` is only declared if something is read
+    FunctionCallee ReadFn = M -> getOrInsertFunction(
+        "calc_read", Builder.getInt32Ty(), Builder.getPtrTy());
+
+    // For each variable, a string with a variable name is created
+    Constant *StrText = ConstantDataArray::getString(M -> getContext(), Var);
+    GlobalVariable *Str = new GlobalVariable(
+        *M, StrText -> getType(),
+        /*isConstant=*/true,
+        GlobalValue::PrivateLinkage,
+        StrText, Twine(Var).concat(".str")
+    );
+
+    // Then the IR code to call the `calc_read()` function is created
+    // The string created in the prev. step is passed as a parameter
+    return Builder.CreateCall(ReadFn, {Str});
+}
+
+// Creates `main()`, which evaluates the expression once for every
+// row of input the runtime provides (see rtcalc.c): once when the
+// values are read from the terminal, once per line with `--batch`:
+//
+//   entry: calc_init(argc, argv)
+//   next:  if (!calc_next()) return 0
+//   body:  reads of the variables, expression, calc_write()
+//
+// Returns the body, which must be ended with `emitNextRow()`
+BasicBlock *createMain(Module *M) {
+    LLVMContext &Ctx = M -> getContext();
+    Type *Int32Ty = Type::getInt32Ty(Ctx);
+    Type *ArgvTy = PointerType::getUnqual(Ctx);
+    Function *MainFn = Function::Create(
+        FunctionType::get(Int32Ty, {Int32Ty, ArgvTy}, false),
+        GlobalValue::ExternalLinkage, "main", M);
+    BasicBlock *Entry = BasicBlock::Create(Ctx, "entry", MainFn);
+    BasicBlock *Next = BasicBlock::Create(Ctx, "next", MainFn);
+    BasicBlock *Body = BasicBlock::Create(Ctx, "body", MainFn);
+    BasicBlock *Exit = BasicBlock::Create(Ctx, "exit", MainFn);
+
+    IRBuilder<> Builder(Entry);
+    FunctionCallee InitFn = M -> getOrInsertFunction(
+        "calc_init", Builder.getVoidTy(), Int32Ty, ArgvTy);
+    Builder.CreateCall(InitFn, {MainFn -> getArg(0), MainFn -> getArg(1)});
+    Builder.CreateBr(Next);
+
+    Builder.SetInsertPoint(Next);
+    FunctionCallee NextFn = M -> getOrInsertFunction("calc_next", Int32Ty);
+    Value *More = Builder.CreateCall(NextFn);
+    Builder.CreateCondBr(Builder.CreateIsNotNull(More), Body, Exit);
+
+    Builder.SetInsertPoint(Exit);
+    Builder.CreateRet(Builder.getInt32(0));
+    return Body;
+}
+
+// Ends the body of `main()`, continuing with the next row
+void emitNextRow(BuilderTy &Builder) {
+    Function *MainFn = Builder.GetInsertBlock() -> getParent();
+    Builder.CreateBr(MainFn -> getEntryBlock().getSingleSuccessor());
+}
+
+// Allocates the array of the variables passed to parts. It is in the
+// entry block, so that the loop in `main()` doesn't grow the stack
+Value *allocateFrame(Function *Fn, unsigned NumVars) {
+    IRBuilder<> Builder(&Fn -> getEntryBlock(), Fn -> getEntryBlock().begin());
+    Type *FrameTy = ArrayType::get(Builder.getInt32Ty(), NumVars);
+    Value *Array = Builder.CreateAlloca(FrameTy, nullptr, "values");
+    return Builder.CreateConstInBoundsGEP2_32(FrameTy, Array, 0, 0);
+}
+
+// Creates the function for a part of an expression, `i32
+// calc.part(i32 *Values)`, which gets the values of the variables
+// through an array, in `with` order
+Function *createPartFunction(Module *M) {
+    FunctionType *Fty = FunctionType::get(
+        Type::getInt32Ty(M -> getContext()),
+        {PointerType::getUnqual(M -> getContext())}, false);
+    Function *Fn = Function::Create(
+        Fty, GlobalValue::InternalLinkage, "calc.part", M);
+    Fn -> addFnAttr(Attribute::NoInline);
+    Fn -> getArg(0) -> setName("values");
+    return Fn;
+}
+
+// Chooses the subtrees of an expression which are generated as
+// functions of their own. Sizes are counted in nodes, and a subtree
+// which is split off counts as a single node (the call) for its
+// parent. So every function gets at most about twice the maximum
+// size, no matter how large or deep the whole tree is
+class Partitioner : public RecursiveASTVisitor<Partitioner> {
+    unsigned MaxSize;
+    SmallVector<unsigned, 32> Sizes;
+public:
+    DenseSet<BinaryOp *> Parts;
+
+    explicit Partitioner(unsigned MaxSize) : MaxSize(MaxSize) {}
+
+    void run(AST *Tree) {
+        traverse(Tree);
+        // The root is the body of the generated function anyway
+        Expr *Root = isa<WithDecl>(Tree) ? cast<WithDecl>(Tree) -> getExpr()
+                                         : cast<Expr>(Tree);
+        if (auto *Op = dyn_cast_or_null<BinaryOp>(Root))
+            Parts.erase(Op);
+    }
+
+    void visitFactor(Factor &) { Sizes.push_back(1); }
+
+    void visitBinaryOp(BinaryOp &Node) {
+        unsigned Size = 1 + Sizes.pop_back_val();
+        Size += Sizes.pop_back_val();
+        if (Size > MaxSize) {
+            Parts.insert(&Node);
+            Size = 1;
+        }
+        Sizes.push_back(Size);
+    }
+};
+
+class ToIRVisitor : public RecursiveASTVisitor<ToIRVisitor> {
     // First, some private members are declared in the visitor.
     // Each compilation unit is represented in LLVM by the `Module`
     // class and the visitor has a pointer to the module called M.
     Module *M;
 
     // For easy IR generation, the Builder (of type IRBuilder<>) is used.
-    IRBuilder<> Builder;
+    // See `BuilderTy` above
+    BuilderTy Builder;
+
+    // Variables bound to a constant with `--bind`. No `calc_read()`
+    // call is emitted for them
+    const StringMap<int32_t> &Bindings;
 
     // LLVM has a class hierarchy to represent types in IR. You
     // can look up the instances for basic types such as i32 from
@@ -27,37 +183,57 @@ class ToIRVisitor : public ASTVisitor {
     PointerType *PtrTy;
     Constant *Int32Zero;
 
-    // Current calculated value, which is updated through the
-    // tree traversal
+    // Value of the whole expression, available after the traversal
     Value *V;
 
     // Maps a variable name to the value returned from the `calc_read()` func
     StringMap<Value *> nameMap;
+
+    // Argument holding the array of variable values, if a function
+    // is generated with `runFunction()` instead of `main()`
+    Value *ArgValues = nullptr;
+
+    // Values of the already lowered operands. The traversal visits
+    // a `BinaryOp` after its operands, so they are on top of the stack
+    SmallVector<Value *, 32> Values;
+
+    // The subtrees generated as functions `i32 calc.part(i32 *Values)`
+    // of their own, chosen by the `Partitioner`. Inside such a function,
+    // variables are loaded from its argument on first use, with the
+    // index from VarIndex. The caller passes Frame: the argument of
+    // `runFunction()`, or an array in `main()` holding the values read
+    const DenseSet<BinaryOp *> &Parts;
+    StringMap<unsigned> VarIndex;
+    Value *Frame;
+
+    // The functions currently being generated for parts, innermost
+    // last, each with the state of the function it is called from
+    struct OpenPart {
+        Function *Fn;
+        BasicBlock *CallerBB;
+        StringMap<Value *> CallerNames;
+    };
+    SmallVector<OpenPart, 4> OpenParts;
 public:
-    ToIRVisitor(Module *M) : M(M), Builder(M -> getContext()) {
+    ToIRVisitor(Module *M, const StringMap<int32_t> &Bindings,
+                const DenseSet<BinaryOp *> &Parts)
+        : M(M), Builder(M -> getContext(), InstSimplifyFolder(M -> getDataLayout())),
+          Bindings(Bindings), Parts(Parts) {
         VoidTy = Type::getVoidTy(M -> getContext());
         Int32Ty = Type::getInt32Ty(M -> getContext());
         PtrTy = PointerType::getUnqual(M -> getContext());
         Int32Zero = ConstantInt::get(Int32Ty, 0, true);
+        Frame = ConstantPointerNull::get(PtrTy);
     }
 
     void run(AST *Tree) {
-        // For each function, a `FunctionType` instance must be created.
-        // In C++ terminology, this is a function prototype.
-        FunctionType *MainFty = FunctionType::get(
-            Int32Ty, {Int32Ty, PtrTy}, false);
-
-        // A function itself is defined with a Function instance
-        Function *MainFn = Function::Create(
-            MainFty, GlobalValue::ExternalLinkage, "main", M);
-        
-        // Then, we create the BB basic block with the entry label
-        // and attach it to the IR builder
-        BasicBlock *BB = BasicBlock::Create(M -> getContext(), "entry", MainFn);
-        Builder.SetInsertPoint(BB);
+        // `main()` loops over the rows of input, see `createMain()`.
+        // The code of the expression goes into the body of the loop
+        Builder.SetInsertPoint(createMain(M));
 
         // With this preparation done, the tree traversal can begin
-        Tree -> accept(*this);
+        traverse(Tree);
+        V = Values.pop_back_val();
 
         // After the tree traversal, the computed value is printed via
         // a call to the `call_write()` function
@@ -68,85 +244,489 @@ public:
             CalcWriteFnTy, GlobalValue::ExternalLinkage, "calc_write", M);
         Builder.CreateCall(CalcWriteFnTy, CalcWriteFn, {V});
 
-        // The generation finished by returning 0 from the `main()` function
-        Builder.CreateRet(Int32Zero);
+        // The generation finishes by continuing with the next row
+        emitNextRow(Builder);
     }
 
-	virtual void visit(WithDecl &Node) override {
-		FunctionType *ReadFty = FunctionType::get(Int32Ty, {PtrTy}, false);
-		Function *ReadFn = Function::Create(ReadFty, GlobalValue::ExternalLinkage, "calc_read", M);
+    // Generates `i32 Name(i32 *Values)` instead of `main()`. The value
+    // of the i-th variable of the `with` list is loaded from Values[i]
+    // and the result is returned instead of printed, so no runtime
+    // functions are needed
+    void runFunction(AST *Tree, StringRef Name) {
+        FunctionType *Fty = FunctionType::get(
+            Int32Ty, {PtrTy}, false);
+        Function *Fn = Function::Create(
+            Fty, GlobalValue::ExternalLinkage, Name, M);
+        ArgValues = Fn -> getArg(0);
+        ArgValues -> setName("values");
+        Frame = ArgValues;
 
+        BasicBlock *BB = BasicBlock::Create(M -> getContext(), "entry", Fn);
+        Builder.SetInsertPoint(BB);
+        traverse(Tree);
+        Builder.CreateRet(Values.pop_back_val());
+    }
+
+	void visitWithDecl(WithDecl &Node) {
 		// Loop through the variable names
 		for (auto I = Node.begin(), E = Node.end(); I != E; ++I) {
-			// For each variable, a string with a variable name is created
 			StringRef Var = *I;
-			Constant *StrText = ConstantDataArray::getString(M -> getContext(), Var);
-			GlobalVariable *Str = new GlobalVariable(
-				*M, StrText -> getType(),
-				/*isConstant=*/true,
-				GlobalValue::PrivateLinkage,
-				StrText, Twine(Var).concat(".str")
-			);
-
-			// Then the IR code to call the `calc_read()` function is created
-			// The string created in the prev. step is passed as a parameter
-			CallInst *Call = Builder.CreateCall(ReadFty, ReadFn, {Str});
-
-			nameMap[Var] = Call;
+			unsigned Idx = I - Node.begin();
+			VarIndex[Var] = Idx;
+
+			// A bound variable is just a constant, which the
+			// builder folds into the expression using it
+			auto Bound = Bindings.find(Var);
+			if (Bound != Bindings.end()) {
+				nameMap[Var] = ConstantInt::get(Int32Ty, Bound -> second, true);
+				continue;
+			}
+
+			if (ArgValues) {
+				Value *Ptr = Builder.CreateConstInBoundsGEP1_32(
+					Int32Ty, ArgValues, Idx);
+				nameMap[Var] = Builder.CreateLoad(Int32Ty, Ptr, Var);
+				continue;
+			}
+
+			nameMap[Var] = emitCalcRead(M, Builder, Var);
 		}
 
-		Node.getExpr() -> accept(*this);
+		// The parts get the values read through an array
+		if (Parts.empty() || ArgValues)
+			return;
+		Frame = allocateFrame(Builder.GetInsertBlock() -> getParent(),
+							Node.end() - Node.begin());
+		for (auto I = Node.begin(), E = Node.end(); I != E; ++I)
+			if (!Bindings.count(*I))
+				Builder.CreateStore(
+					nameMap[*I],
+					Builder.CreateConstInBoundsGEP1_32(Int32Ty, Frame,
+													   I - Node.begin()));
+	}
+
+	// Loads a variable inside a part, the first time it is used there
+	Value *getVar(StringRef Var) {
+		Value *&V = nameMap[Var];
+		if (V)
+			return V;
+		auto Bound = Bindings.find(Var);
+		if (Bound != Bindings.end())
+			return V = ConstantInt::get(Int32Ty, Bound -> second, true);
+		Value *Ptr = Builder.CreateConstInBoundsGEP1_32(
+			Int32Ty, OpenParts.back().Fn -> getArg(0), VarIndex[Var]);
+		return V = Builder.CreateLoad(Int32Ty, Ptr, Var);
 	}
 
-	virtual void visit(Factor &Node) override {
+	void visitFactor(Factor &Node) {
 		// A Factor node is either a variable name or a number
 		if (Node.getKind() == Factor::Ident) {
 			// For a variable name, the value is looked up in the
 			// mapNames map. For a number, the value is converted to
 			// an integer and turned into a constant value
-			V = nameMap[Node.getVal()];
+			Values.push_back(getVar(Node.getVal()));
 		} else {
-			// For a number, the value is converted to an integer
-			// and turned into a constant value
-			int intval;
-			Node.getVal().getAsInteger(10, intval);
-			V = ConstantInt::get(Int32Ty, intval, true);
+			// For a number, the value was already converted to an
+			// integer by the lexer and is turned into a constant value
+			Values.push_back(
+				ConstantInt::get(Int32Ty, Node.getIntVal(), true));
 		}
 	}
 
-	virtual void visit(BinaryOp &Node) override {
-		Node.getLeft() -> accept(*this);
-		Value *Left = V;
-		Node.getRight() -> accept(*this);
-		Value *Right = V;
-		switch (Node.getOperator()) {
-		case BinaryOp::Plus:
-			V = Builder.CreateNSWAdd(Left, Right);
-			break;
-		case BinaryOp::Minus:
-			V = Builder.CreateNSWSub(Left, Right);
-			break;
-		case BinaryOp::Mul:
-			V = Builder.CreateNSWMul(Left, Right);
-			break;
-		case BinaryOp::Div:
-			V = Builder.CreateSDiv(Left, Right);
-			break;
+	// A part starts a new function, and continues the
+	// traversal of its subtree there
+	void enterBinaryOp(BinaryOp &Node) {
+		if (!Parts.count(&Node))
+			return;
+		Function *Fn = createPartFunction(M);
+		OpenParts.push_back({Fn, Builder.GetInsertBlock(), std::move(nameMap)});
+		nameMap.clear();
+		Builder.SetInsertPoint(BasicBlock::Create(M -> getContext(), "entry", Fn));
+	}
+
+	void visitBinaryOp(BinaryOp &Node) {
+		Value *Right = Values.pop_back_val();
+		Value *Left = Values.pop_back_val();
+		Value *V = emitBinaryOp(Builder, Node.getOperator(), Left, Right);
+		if (Parts.count(&Node)) {
+			// The part is complete, so its value is returned, and
+			// the caller continues with a call
+			OpenPart Part = OpenParts.pop_back_val();
+			Builder.CreateRet(V);
+			Builder.SetInsertPoint(Part.CallerBB);
+			nameMap = std::move(Part.CallerNames);
+			// A part called from another part passes its own argument on
+			Value *Args = OpenParts.empty() ? Frame
+											: OpenParts.back().Fn -> getArg(0);
+			V = Builder.CreateCall(Part.Fn, {Args});
 		}
+		Values.push_back(V);
 	}
 };
 }
 
 // The visitor class is now complete
 
+namespace {
+// Generates `main()` while the parser runs, instead of from an AST.
+// Declarations are checked as the variables are used, and the value
+// of every operand is emitted as soon as the parser reduces it. The
+// only state besides the IR are the handles of the operands on the
+// parser's stack, so memory grows with the nesting depth of the
+// input, and not with its size (which the IR is proportional to).
+//
+// The instructions of an operand are contiguous at the end of the
+// block: the parser reduces an operator right after its operands.
+// So splitting off a part (see `CodeGen::setMaxFunctionSize()`) only
+// needs to know where its subtree started: the instructions from
+// there on are moved into a new function, and replaced by a call.
+class StreamingIRBuilder : public ParserActions {
+    struct Operand {
+        Value *V;
+        // The last instruction in front of the ones of this operand,
+        // or null if there are none in front of them besides the
+        // reads of the variables (`ExprStart`)
+        Instruction *Before;
+        // Nodes in the subtree, with a split off part counting as one
+        unsigned Size;
+    };
+
+    Module *M;
+    BuilderTy Builder;
+    const StringMap<int32_t> &Bindings;
+    unsigned MaxSize;
+    BasicBlock *MainBB;
+    bool HasError = false;
+    bool Done = false;
+
+    // The value of every declared variable, and the variable of
+    // every value read, with its index in the `with` list. Reads
+    // holds the values read in `with` order, null if bound
+    StringMap<Value *> Vars;
+    DenseMap<Value *, unsigned> ReadIndex;
+    SmallVector<Value *, 8> Reads;
+
+    // The array with the variables passed to parts, created when
+    // the first part is split off, and the last instruction before
+    // the ones of the expression
+    Value *Frame = nullptr;
+    Instruction *ExprStart = nullptr;
+
+    // The handles given to the parser, reused once they are reduced
+    std::vector<std::unique_ptr<Operand>> Operands;
+    SmallVector<Operand *, 16> FreeOperands;
+
+    void error(StringRef Var, bool Twice) {
+        errs() << "Variable " << Var << " " << (Twice ? "already" : "not")
+               << " declared\n";
+        HasError = true;
+    }
+
+    Operand *newOperand(Value *V) {
+        if (FreeOperands.empty()) {
+            Operands.push_back(std::make_unique<Operand>());
+            FreeOperands.push_back(Operands.back().get());
+        }
+        Operand *Op = FreeOperands.pop_back_val();
+        Instruction *Last = MainBB -> empty() ? nullptr : &MainBB -> back();
+        *Op = {V, Last == ExprStart ? nullptr : Last, 1};
+        return Op;
+    }
+
+    void release(ExprHandle E) {
+        if (E)
+            FreeOperands.push_back(static_cast<Operand *>(E));
+    }
+
+    BasicBlock::iterator after(Instruction *I) {
+        if (!I)
+            return ExprStart ? after(ExprStart) : MainBB -> begin();
+        return std::next(I -> getIterator());
+    }
+
+    // Stores the variables read into an array, in front of the
+    // instructions of the expression
+    void createFrame() {
+        Builder.SetInsertPoint(MainBB, after(ExprStart));
+        Frame = allocateFrame(MainBB -> getParent(), Reads.size());
+        for (unsigned Idx = 0; Idx < Reads.size(); ++Idx)
+            if (Reads[Idx])
+                Builder.CreateStore(
+                    Reads[Idx], Builder.CreateConstInBoundsGEP1_32(
+                                    Builder.getInt32Ty(), Frame, Idx));
+        // Without reads, e.g. if all variables are bound, nothing
+        // was inserted
+        if (Builder.GetInsertPoint() != MainBB -> begin())
+            ExprStart = &*std::prev(Builder.GetInsertPoint());
+        Builder.SetInsertPoint(MainBB);
+    }
+
+    // Moves the instructions of Op into a new function
+    void splitOff(Operand &Op) {
+        if (!Frame)
+            createFrame();
+        Function *Fn = createPartFunction(M);
+        BasicBlock *BB = BasicBlock::Create(M -> getContext(), "entry", Fn);
+        BB -> splice(BB -> end(), MainBB, after(Op.Before), MainBB -> end());
+
+        // Variables are loaded from the argument instead, on first
+        // use, and nested parts get the argument passed on
+        Builder.SetInsertPoint(&BB -> front());
+        DenseMap<Value *, Value *> Loaded;
+        for (Instruction &I : *BB) {
+            for (Use &U : I.operands()) {
+                if (U.get() == Frame) {
+                    U.set(Fn -> getArg(0));
+                    continue;
+                }
+                auto Read = ReadIndex.find(U.get());
+                if (Read == ReadIndex.end())
+                    continue;
+                Value *&Load = Loaded[U.get()];
+                if (!Load)
+                    Load = Builder.CreateLoad(
+                        Builder.getInt32Ty(),
+                        Builder.CreateConstInBoundsGEP1_32(
+                            Builder.getInt32Ty(), Fn -> getArg(0), Read -> second));
+                U.set(Load);
+            }
+        }
+        Builder.SetInsertPoint(BB);
+        Builder.CreateRet(Op.V);
+
+        Builder.SetInsertPoint(MainBB);
+        Op.V = Builder.CreateCall(Fn, {Frame});
+        Op.Size = 1;
+    }
+
+public:
+    StreamingIRBuilder(Module *M, const StringMap<int32_t> &Bindings,
+                       unsigned MaxSize)
+        : M(M), Builder(M -> getContext(), InstSimplifyFolder(M -> getDataLayout())),
+          Bindings(Bindings), MaxSize(MaxSize) {
+        MainBB = createMain(M);
+        Builder.SetInsertPoint(MainBB);
+    }
+
+    // Returns false if errors were reported
+    bool finish() {
+        for (auto &Binding : Bindings)
+            if (!Vars.count(Binding.first())) {
+                errs() << "Bound variable " << Binding.first()
+                       << " not declared\n";
+                HasError = true;
+            }
+        return Done && !HasError;
+    }
+
+    void actOnWithDecl(ArrayRef<StringRef> Names) override {
+        Reads.resize(Names.size());
+        for (unsigned Idx = 0; Idx < Names.size(); ++Idx) {
+            StringRef Var = Names[Idx];
+            if (Vars.count(Var)) {
+                error(Var, /*Twice=*/true);
+                continue;
+            }
+            auto Bound = Bindings.find(Var);
+            if (Bound != Bindings.end()) {
+                Vars[Var] = Builder.getInt32(Bound -> second);
+                continue;
+            }
+            Value *Read = emitCalcRead(M, Builder, Var);
+            Vars[Var] = Read;
+            ReadIndex[Read] = Idx;
+            Reads[Idx] = Read;
+        }
+        ExprStart = MainBB -> empty() ? nullptr : &MainBB -> back();
+    }
+
+    ExprHandle actOnNumber(StringRef, int32_t Value) override {
+        return newOperand(Builder.getInt32(Value));
+    }
+
+    ExprHandle actOnIdent(StringRef Name) override {
+        auto Var = Vars.find(Name);
+        if (Var == Vars.end()) {
+            error(Name, /*Twice=*/false);
+            return nullptr;
+        }
+        return newOperand(Var -> second);
+    }
+
+    ExprHandle actOnBinaryOp(BinaryOp::Operator Op, ExprHandle Left,
+                             ExprHandle Right) override {
+        if (!Left || !Right) {
+            release(Left);
+            release(Right);
+            HasError = true;
+            return nullptr;
+        }
+        auto *L = static_cast<Operand *>(Left);
+        auto *R = static_cast<Operand *>(Right);
+        L -> V = emitBinaryOp(Builder, Op, L -> V, R -> V);
+        L -> Size += R -> Size + 1;
+        release(R);
+        // A result which isn't a new instruction, like a constant,
+        // has nothing to split off
+        auto *I = dyn_cast<Instruction>(L -> V);
+        if (L -> Size > MaxSize && I && !ReadIndex.count(I))
+            splitOff(*L);
+        return L;
+    }
+
+    void actOnCalc(ExprHandle E) override {
+        if (!E) {
+            HasError = true;
+            return;
+        }
+        // The value is printed, and `main()` continues with the next row
+        FunctionCallee WriteFn = M -> getOrInsertFunction(
+            "calc_write", Builder.getVoidTy(), Builder.getInt32Ty());
+        Builder.CreateCall(WriteFn, {static_cast<Operand *>(E) -> V});
+        emitNextRow(Builder);
+        release(E);
+        Done = true;
+    }
+};
+
+// Generates the function of a kernel, computing several expressions
+// at once. The IR is hash-consed: an operation whose operator and
+// operands were seen before - in the same or another expression -
+// reuses the value computed then. As operands are values, not
+// trees, this finds equal subtrees bottom up in a single pass.
+// Inputs are loaded on first use, which dominates all other uses,
+// as the function is a single basic block
+class KernelBuilder : public RecursiveASTVisitor<KernelBuilder> {
+    Module *M;
+    BuilderTy Builder;
+    const StringMap<int32_t> &Bindings;
+    Type *Int32Ty;
+
+    Value *ArgInputs = nullptr;
+    StringMap<unsigned> InputIndex;
+    StringMap<Value *> Loaded;
+    DenseMap<std::tuple<unsigned, Value *, Value *>, Value *> Computed;
+    SmallVector<Value *, 32> Values;
+
+    Value *getInput(StringRef Var) {
+        Value *&V = Loaded[Var];
+        if (V)
+            return V;
+        auto Bound = Bindings.find(Var);
+        if (Bound != Bindings.end())
+            return V = ConstantInt::get(Int32Ty, Bound -> second, true);
+        Value *Ptr = Builder.CreateConstInBoundsGEP1_32(
+            Int32Ty, ArgInputs, InputIndex.lookup(Var));
+        return V = Builder.CreateLoad(Int32Ty, Ptr, Var);
+    }
+public:
+    KernelBuilder(Module *M, const StringMap<int32_t> &Bindings)
+        : M(M), Builder(M -> getContext(), InstSimplifyFolder(M -> getDataLayout())),
+          Bindings(Bindings) {
+        Int32Ty = Type::getInt32Ty(M -> getContext());
+    }
+
+	void run(ArrayRef<AST *> Trees, ArrayRef<StringRef> InputNames,
+			 StringRef Name) {
+		Type *PtrTy = PointerType::getUnqual(M -> getContext());
+		FunctionType *Fty = FunctionType::get(
+			Type::getVoidTy(M -> getContext()), {PtrTy, PtrTy}, false);
+		Function *Fn = Function::Create(
+			Fty, GlobalValue::ExternalLinkage, Name, M);
+		// The outputs never overlap the inputs, so storing a result
+		// doesn't force the backend to load an input again
+		ArgInputs = Fn -> getArg(0);
+		ArgInputs -> setName("inputs");
+		Fn -> addParamAttr(0, Attribute::NoAlias);
+		Fn -> addParamAttr(0, Attribute::ReadOnly);
+		Value *ArgOutputs = Fn -> getArg(1);
+		ArgOutputs -> setName("outputs");
+		Fn -> addParamAttr(1, Attribute::NoAlias);
+		for (auto I = InputNames.begin(), E = InputNames.end(); I != E; ++I)
+			InputIndex[*I] = I - InputNames.begin();
+
+		Builder.SetInsertPoint(BasicBlock::Create(M -> getContext(), "entry", Fn));
+		for (auto I = Trees.begin(), E = Trees.end(); I != E; ++I) {
+			traverse(*I);
+			Builder.CreateStore(
+				Values.pop_back_val(),
+				Builder.CreateConstInBoundsGEP1_32(Int32Ty, ArgOutputs,
+												   I - Trees.begin()));
+		}
+		Builder.CreateRetVoid();
+	}
+
+	void visitFactor(Factor &Node) {
+		if (Node.getKind() == Factor::Ident)
+			Values.push_back(getInput(Node.getVal()));
+		else
+			Values.push_back(ConstantInt::get(Int32Ty, Node.getIntVal(), true));
+	}
+
+	void visitBinaryOp(BinaryOp &Node) {
+		Value *Right = Values.pop_back_val();
+		Value *Left = Values.pop_back_val();
+		BinaryOp::Operator Op = Node.getOperator();
+		auto It = Computed.find({Op, Left, Right});
+		// `a+b` and `b+a` are the same, and so are `a*b` and `b*a`
+		if (It == Computed.end() && (Op == BinaryOp::Plus || Op == BinaryOp::Mul))
+			It = Computed.find({Op, Right, Left});
+		if (It != Computed.end()) {
+			Values.push_back(It -> second);
+			return;
+		}
+		Value *V = emitBinaryOp(Builder, Op, Left, Right);
+		Computed[{Op, Left, Right}] = V;
+		Values.push_back(V);
+	}
+};
+} // namespace
+
+std::unique_ptr<Module> CodeGen::generate(AST *Tree, LLVMContext &Ctx) {
+	// This method creates the module and runs the tree traversal
+	auto M = std::make_unique<Module>("calc.expr", Ctx);
+	Partitioner Partition(MaxFunctionSize ? MaxFunctionSize : ~0u);
+	Partition.run(Tree);
+	ToIRVisitor ToIR(M.get(), Bindings, Partition.Parts);
+	ToIR.run(Tree);
+	return M;
+}
+
+std::unique_ptr<Module> CodeGen::generateFunction(AST *Tree, LLVMContext &Ctx,
+													StringRef Name) {
+	auto M = std::make_unique<Module>("calc.expr", Ctx);
+	Partitioner Partition(MaxFunctionSize ? MaxFunctionSize : ~0u);
+	Partition.run(Tree);
+	ToIRVisitor ToIR(M.get(), Bindings, Partition.Parts);
+	ToIR.runFunction(Tree, Name);
+	return M;
+}
+
+std::unique_ptr<Module> CodeGen::generateKernel(ArrayRef<AST *> Trees,
+												ArrayRef<StringRef> InputNames,
+												LLVMContext &Ctx,
+												StringRef Name) {
+	auto M = std::make_unique<Module>("calc.kernel", Ctx);
+	KernelBuilder Kernel(M.get(), Bindings);
+	Kernel.run(Trees, InputNames, Name);
+	return M;
+}
+
+std::unique_ptr<Module> CodeGen::generateStreaming(Parser &P, LLVMContext &Ctx) {
+	auto M = std::make_unique<Module>("calc.expr", Ctx);
+	StreamingIRBuilder Builder(M.get(), Bindings,
+							   MaxFunctionSize ? MaxFunctionSize : ~0u);
+	P.parse(Builder);
+	if (!Builder.finish() || P.hasError())
+		return nullptr;
+	return M;
+}
+
 void CodeGen::compile(AST *Tree) {
-	// This method creates the global context
-	// and the module, runs the tree traversal, and
-	// dumps the generated IR to the console
+	// This method creates the global context, generates
+	// the module and dumps the IR to the console
 	LLVMContext Ctx;
-	Module *M = new Module("calc.expr", Ctx);
-	ToIRVisitor ToIR(M);
-	ToIR.run(Tree);
+	std::unique_ptr<Module> M = generate(Tree, Ctx);
 	M -> print(outs(), nullptr);
 }
 
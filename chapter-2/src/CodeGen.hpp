@@ -3,8 +3,66 @@
 
 #include "AST.h"
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include <memory>
+
+class Parser;
+
 class CodeGen {
+    // Variables with a value known at compile time
+    llvm::StringMap<int32_t> Bindings;
+    // See `setMaxFunctionSize()`
+    unsigned MaxFunctionSize = 0;
 public:
+    // Binds the variable `Name` to a constant. The generated code
+    // doesn't read the variable, but uses the constant instead, and
+    // everything that only depends on constants is folded
+    void bind(llvm::StringRef Name, int32_t Value) { Bindings[Name] = Value; }
+
+    // Subtrees of more than `Size` nodes are generated as functions
+    // of their own, called from the expression. The backend works on
+    // one function at a time, and some of its algorithms don't scale
+    // linearly, so this keeps huge expressions compiling in linear
+    // time. It also allows the functions to be compiled in parallel
+    // (see ObjectEmitter.hpp). 0, the default, puts everything into
+    // one function
+    void setMaxFunctionSize(unsigned Size) { MaxFunctionSize = Size; }
+
+    // Lowers the tree into a new module owned by the caller
+    std::unique_ptr<llvm::Module> generate(AST *Tree, llvm::LLVMContext &Ctx);
+
+    // Lowers the tree into a module with the single function
+    // `i32 Name(i32 *Values)`, which returns the value of the
+    // expression for the variables in Values, in `with` order
+    std::unique_ptr<llvm::Module> generateFunction(AST *Tree,
+                                                   llvm::LLVMContext &Ctx,
+                                                   llvm::StringRef Name);
+
+    // Lowers several expressions into a module with the single
+    // function `void Name(i32 *Inputs, i32 *Outputs)`, which stores
+    // the value of the i-th tree in Outputs[i]. Inputs holds the
+    // values of the variables in InputNames, which must include all
+    // variables of the trees. A variable is the same input in every
+    // expression using it, so it is loaded only once, and equal
+    // subexpressions are computed only once for all outputs. The
+    // expressions are not split into functions
+    std::unique_ptr<llvm::Module> generateKernel(llvm::ArrayRef<AST *> Trees,
+                                                 llvm::ArrayRef<llvm::StringRef> InputNames,
+                                                 llvm::LLVMContext &Ctx,
+                                                 llvm::StringRef Name);
+
+    // Generates `main()` while `P` parses the input, without building
+    // an AST, so huge inputs need little memory besides the IR. The
+    // declarations are checked on the way, which replaces `Sema`.
+    // Returns null if errors were reported
+    std::unique_ptr<llvm::Module> generateStreaming(Parser &P,
+                                                    llvm::LLVMContext &Ctx);
+
+    // Generates the module and prints its IR to stdout
     void compile(AST *Tree);
 };
 
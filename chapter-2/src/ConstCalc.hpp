@@ -0,0 +1,330 @@
+#ifndef CONST_CALC_H
+#define CONST_CALC_H
+
+// Compile time evaluation of calc expressions (requires C++20). For
+// expressions that are already known when the C++ program is built,
+// the string literal is lexed and parsed by the C++ compiler itself:
+//
+//   int32_t R = calc::ct<"with a,b: a*(b+3)">(A, B);
+//
+// The parse result is turned into a chain of template instances, one
+// per node of the tree, so the call compiles down to the same few
+// instructions as the hand written `A*(B+3)`. Nothing of the parser
+// is left in the program. With constant arguments, the whole call
+// is a constant expression:
+//
+//   static_assert(calc::ct<"with a: a*2">(21) == 42);
+//
+// The language is the one of the `calc` driver and libcalc: the
+// lexer, the grammar, the checks of `Sema` and the arithmetic (32 bit,
+// overflow and division by zero are undefined) are the same. A
+// syntax or semantic error makes the call ill-formed; the compiler
+// then points at the `error()` call explaining it.
+//
+// This header doesn't depend on LLVM or on the rest of calc.
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace calc {
+
+namespace ct_detail {
+// A string literal usable as a template argument
+template <std::size_t N> struct FixedString {
+    char Chars[N];
+
+    constexpr FixedString(const char (&Str)[N]) {
+        for (std::size_t I = 0; I < N; ++I)
+            Chars[I] = Str[I];
+    }
+};
+
+// Not constexpr: reaching this during constant evaluation is what
+// turns an error in the expression into a compile error
+inline void error(const char *) {}
+
+enum class NodeKind : uint8_t { Number, Var, Plus, Minus, Mul, Div };
+
+// A node of the tree. Value is the value of a number or the index of
+// a variable in the `with` list; Left and Right index the operands
+struct Node {
+    NodeKind Kind = NodeKind::Number;
+    int32_t Value = 0;
+    uint32_t Left = 0, Right = 0;
+};
+
+// The parsed expression. Every node consumes at least one character
+// of the input, so the length of the input bounds the number of
+// nodes, variables and pending operators
+template <std::size_t N> struct Program {
+    Node Nodes[N] = {};
+    uint32_t NumNodes = 0;
+    uint32_t Root = 0;
+    uint32_t NumVars = 0;
+};
+
+constexpr bool isWhitespace(char C) {
+    return C == ' ' || C == '\t' || C == '\f' || C == '\v' ||
+           C == '\r' || C == '\n';
+}
+
+constexpr bool isDigit(char C) { return C >= '0' && C <= '9'; }
+
+constexpr bool isLetter(char C) {
+    return (C >= 'a' && C <= 'z') || (C >= 'A' && C <= 'Z');
+}
+
+enum class TokenKind : uint8_t {
+    eoi, unknown, ident, number, comma, colon,
+    plus, minus, star, slash, l_paren, r_paren, KW_with
+};
+
+struct Token {
+    TokenKind Kind = TokenKind::eoi;
+    std::size_t Begin = 0, End = 0;
+};
+
+// The same rules as `Lexer`
+template <std::size_t N> class Lexer {
+    const char (&Buffer)[N];
+    std::size_t Pos = 0;
+
+public:
+    constexpr explicit Lexer(const char (&Buffer)[N]) : Buffer(Buffer) {}
+
+    constexpr Token next() {
+        while (Pos < N - 1 && isWhitespace(Buffer[Pos]))
+            ++Pos;
+        Token Tok{TokenKind::eoi, Pos, Pos};
+        if (Pos >= N - 1)
+            return Tok;
+        char C = Buffer[Pos++];
+        if (isLetter(C)) {
+            while (Pos < N - 1 && isLetter(Buffer[Pos]))
+                ++Pos;
+            Tok.Kind = Pos - Tok.Begin == 4 && Buffer[Tok.Begin] == 'w' &&
+                               Buffer[Tok.Begin + 1] == 'i' &&
+                               Buffer[Tok.Begin + 2] == 't' &&
+                               Buffer[Tok.Begin + 3] == 'h'
+                           ? TokenKind::KW_with
+                           : TokenKind::ident;
+        } else if (isDigit(C)) {
+            while (Pos < N - 1 && isDigit(Buffer[Pos]))
+                ++Pos;
+            Tok.Kind = TokenKind::number;
+        } else {
+            switch (C) {
+            case '+': Tok.Kind = TokenKind::plus; break;
+            case '-': Tok.Kind = TokenKind::minus; break;
+            case '*': Tok.Kind = TokenKind::star; break;
+            case '/': Tok.Kind = TokenKind::slash; break;
+            case '(': Tok.Kind = TokenKind::l_paren; break;
+            case ')': Tok.Kind = TokenKind::r_paren; break;
+            case ':': Tok.Kind = TokenKind::colon; break;
+            case ',': Tok.Kind = TokenKind::comma; break;
+            default: Tok.Kind = TokenKind::unknown; break;
+            }
+        }
+        Tok.End = Pos;
+        return Tok;
+    }
+};
+
+// The same grammar as `Parser`, including the shunting-yard
+// expression parser, but without error recovery: the first error
+// ends the compilation anyway
+template <std::size_t N> class Parser {
+    const char (&Buffer)[N];
+    Lexer<N> Lex;
+    Token Tok;
+    Program<N> Prog;
+    Token Vars[N] = {};
+
+    constexpr void advance() { Tok = Lex.next(); }
+
+    constexpr void expect(TokenKind Kind) {
+        if (Tok.Kind != Kind)
+            error("Unexpected token in calc expression");
+    }
+
+    constexpr bool sameText(const Token &A, const Token &B) const {
+        if (A.End - A.Begin != B.End - B.Begin)
+            return false;
+        for (std::size_t I = 0; I < A.End - A.Begin; ++I)
+            if (Buffer[A.Begin + I] != Buffer[B.Begin + I])
+                return false;
+        return true;
+    }
+
+    constexpr uint32_t addNode(NodeKind Kind, int32_t Value,
+                               uint32_t Left = 0, uint32_t Right = 0) {
+        Prog.Nodes[Prog.NumNodes] = {Kind, Value, Left, Right};
+        return Prog.NumNodes++;
+    }
+
+    constexpr uint32_t parseFactor() {
+        if (Tok.Kind == TokenKind::number) {
+            int64_t Value = 0;
+            for (std::size_t I = Tok.Begin; I < Tok.End; ++I) {
+                Value = Value * 10 + (Buffer[I] - '0');
+                if (Value > INT32_MAX)
+                    error("Number out of range");
+            }
+            advance();
+            return addNode(NodeKind::Number, static_cast<int32_t>(Value));
+        }
+        expect(TokenKind::ident);
+        for (uint32_t I = 0; I < Prog.NumVars; ++I)
+            if (sameText(Vars[I], Tok)) {
+                advance();
+                return addNode(NodeKind::Var, static_cast<int32_t>(I));
+            }
+        error("Variable not declared");
+        return 0;
+    }
+
+    static constexpr unsigned getPrecedence(NodeKind Op) {
+        return (Op == NodeKind::Mul || Op == NodeKind::Div) ? 2 : 1;
+    }
+
+    static constexpr bool isBinaryOperator(TokenKind Kind) {
+        return Kind == TokenKind::plus || Kind == TokenKind::minus ||
+               Kind == TokenKind::star || Kind == TokenKind::slash;
+    }
+
+    static constexpr NodeKind getOperator(TokenKind Kind) {
+        switch (Kind) {
+        case TokenKind::plus: return NodeKind::Plus;
+        case TokenKind::minus: return NodeKind::Minus;
+        case TokenKind::star: return NodeKind::Mul;
+        default: return NodeKind::Div;
+        }
+    }
+
+    constexpr uint32_t parseExpr() {
+        // Operator stack entries are operators or, for an open
+        // parenthesis, the Number kind
+        uint32_t Operands[N] = {};
+        NodeKind Operators[N] = {};
+        std::size_t NumOperands = 0, NumOperators = 0;
+        unsigned Depth = 0;
+
+        auto Reduce = [&] {
+            uint32_t Right = Operands[--NumOperands];
+            uint32_t Left = Operands[--NumOperands];
+            Operands[NumOperands++] =
+                addNode(Operators[--NumOperators], 0, Left, Right);
+        };
+
+        for (;;) {
+            while (Tok.Kind == TokenKind::l_paren) {
+                Operators[NumOperators++] = NodeKind::Number;
+                ++Depth;
+                advance();
+            }
+            Operands[NumOperands++] = parseFactor();
+
+            for (;;) {
+                if (isBinaryOperator(Tok.Kind)) {
+                    NodeKind Op = getOperator(Tok.Kind);
+                    while (NumOperators &&
+                           Operators[NumOperators - 1] != NodeKind::Number &&
+                           getPrecedence(Operators[NumOperators - 1]) >=
+                               getPrecedence(Op))
+                        Reduce();
+                    Operators[NumOperators++] = Op;
+                    advance();
+                    break;
+                }
+
+                if (Depth == 0) {
+                    while (NumOperators)
+                        Reduce();
+                    return Operands[0];
+                }
+
+                expect(TokenKind::r_paren);
+                advance();
+                while (Operators[NumOperators - 1] != NodeKind::Number)
+                    Reduce();
+                --NumOperators;
+                --Depth;
+            }
+        }
+    }
+
+public:
+    constexpr explicit Parser(const char (&Buffer)[N])
+        : Buffer(Buffer), Lex(Buffer) {
+        advance();
+    }
+
+    constexpr Program<N> parse() {
+        if (Tok.Kind == TokenKind::KW_with) {
+            do {
+                advance();
+                expect(TokenKind::ident);
+                for (uint32_t I = 0; I < Prog.NumVars; ++I)
+                    if (sameText(Vars[I], Tok))
+                        error("Variable already declared");
+                Vars[Prog.NumVars++] = Tok;
+                advance();
+            } while (Tok.Kind == TokenKind::comma);
+            expect(TokenKind::colon);
+            advance();
+        }
+        Prog.Root = parseExpr();
+        expect(TokenKind::eoi);
+        return Prog;
+    }
+};
+
+template <FixedString Source>
+inline constexpr auto Parsed = Parser<sizeof(Source.Chars)>(Source.Chars).parse();
+
+// Evaluates node I of the expression. Each node is its own
+// instantiation, so the tree is resolved completely at compile time
+template <FixedString Source, uint32_t I>
+constexpr int32_t evaluate(const int32_t *Values) {
+    constexpr Node N = Parsed<Source>.Nodes[I];
+    if constexpr (N.Kind == NodeKind::Number) {
+        return N.Value;
+    } else if constexpr (N.Kind == NodeKind::Var) {
+        return Values[N.Value];
+    } else {
+        int32_t Left = evaluate<Source, N.Left>(Values);
+        int32_t Right = evaluate<Source, N.Right>(Values);
+        if constexpr (N.Kind == NodeKind::Plus)
+            return Left + Right;
+        else if constexpr (N.Kind == NodeKind::Minus)
+            return Left - Right;
+        else if constexpr (N.Kind == NodeKind::Mul)
+            return Left * Right;
+        else
+            return Left / Right;
+    }
+}
+} // namespace ct_detail
+
+// Evaluates the expression Source, passing the values of the
+// variables in `with` order
+template <ct_detail::FixedString Source, typename... Args>
+    requires(std::is_convertible_v<Args, int32_t> && ...)
+constexpr int32_t ct(Args... Values) {
+    static_assert(sizeof...(Args) == ct_detail::Parsed<Source>.NumVars,
+                  "Wrong number of values for the variables of the "
+                  "expression");
+    // One extra element, so that the array isn't empty
+    const int32_t ValueArray[] = {static_cast<int32_t>(Values)..., 0};
+    return ct_detail::evaluate<Source, ct_detail::Parsed<Source>.Root>(
+        ValueArray);
+}
+
+// The number of variables of the expression Source
+template <ct_detail::FixedString Source>
+inline constexpr unsigned ct_num_vars = ct_detail::Parsed<Source>.NumVars;
+
+} // namespace calc
+
+#endif
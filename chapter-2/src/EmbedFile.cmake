@@ -0,0 +1,14 @@
+# Writes the bytes of the file INPUT as the initializer of a C++
+# array to OUTPUT, which is included like
+#
+#   static const unsigned char Data[] = {
+#   #include "File.inc"
+#   };
+#
+# Run at build time with `cmake -DINPUT=... -DOUTPUT=... -P EmbedFile.cmake`
+file(READ ${INPUT} Hex HEX)
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," Bytes "${Hex}")
+string(REGEX REPLACE "(0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,)"
+       "\\1\n" Bytes "${Bytes}")
+get_filename_component(Name ${INPUT} NAME)
+file(WRITE ${OUTPUT} "// Generated from ${Name}, do not edit\n${Bytes}\n")
@@ -0,0 +1,95 @@
+#include "Evaluator.hpp"
+
+#include "llvm/Support/Threading.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <future>
+#include <memory>
+#include <vector>
+
+using namespace llvm;
+using namespace calc;
+
+namespace {
+// Rows per chunk. Big enough that claiming a chunk is rare compared
+// to evaluating it, small enough that stealing can balance the load.
+// A multiple of 16, so chunks of results start on a new cache line
+// (when the result array itself is aligned)
+constexpr size_t ChunkRows = 4096;
+
+// The chunks [Next, End) not yet claimed from one worker's share.
+// Both the owner and thieves claim chunks by incrementing Next,
+// so no chunk is evaluated twice. The padding keeps the counters of
+// different workers on different cache lines
+struct alignas(64) Share {
+    std::atomic<size_t> Next{0};
+    size_t End = 0;
+};
+
+void evaluateChunks(const CompiledExpr &Expr, ArrayRef<int32_t> Rows,
+                    MutableArrayRef<int32_t> Results, size_t FirstChunk,
+                    size_t LastChunk) {
+    CompiledExpr::FunctionTy Fn = Expr.getFunction();
+    unsigned NumVars = Expr.getNumVars();
+    size_t Begin = FirstChunk * ChunkRows;
+    size_t End = std::min(LastChunk * ChunkRows, Results.size());
+    const int32_t *Values = Rows.data() + Begin * NumVars;
+    for (size_t Row = Begin; Row < End; ++Row, Values += NumVars)
+        Results[Row] = Fn(Values);
+}
+
+// Work loop of worker Self: first its own share, then the shares of
+// the others, visited round robin starting with the next worker
+void work(const CompiledExpr &Expr, ArrayRef<int32_t> Rows,
+          MutableArrayRef<int32_t> Results, Share *Shares,
+          unsigned NumWorkers, unsigned Self) {
+    for (unsigned I = 0; I < NumWorkers; ++I) {
+        Share &S = Shares[(Self + I) % NumWorkers];
+        for (;;) {
+            // Relaxed is enough: the results are published by the
+            // futures the calling thread waits on
+            size_t Chunk = S.Next.fetch_add(1, std::memory_order_relaxed);
+            if (Chunk >= S.End)
+                break;
+            evaluateChunks(Expr, Rows, Results, Chunk, Chunk + 1);
+        }
+    }
+}
+} // namespace
+
+Evaluator::Evaluator(unsigned NumThreads)
+    : Pool(hardware_concurrency(NumThreads)) {}
+
+void Evaluator::run(const CompiledExpr &Expr, ArrayRef<int32_t> Rows,
+                    MutableArrayRef<int32_t> Results) {
+    assert(Expr && "Evaluating an empty CompiledExpr");
+    assert(Rows.size() == Results.size() * Expr.getNumVars() &&
+           "Rows don't match the number of results");
+
+    size_t NumChunks = (Results.size() + ChunkRows - 1) / ChunkRows;
+    unsigned NumWorkers = std::min<size_t>(getNumThreads(), NumChunks);
+    if (NumWorkers <= 1) {
+        evaluateChunks(Expr, Rows, Results, 0, NumChunks);
+        return;
+    }
+
+    // Worker I initially owns the chunks [I*N/W, (I+1)*N/W)
+    std::unique_ptr<Share[]> Shares(new Share[NumWorkers]);
+    for (unsigned I = 0; I < NumWorkers; ++I) {
+        Shares[I].Next = NumChunks * I / NumWorkers;
+        Shares[I].End = NumChunks * (I + 1) / NumWorkers;
+    }
+
+    // The calling thread waits for its own tasks only, instead of
+    // ThreadPool::wait(), so several threads can share one Evaluator
+    std::vector<std::shared_future<void>> Done;
+    Done.reserve(NumWorkers);
+    for (unsigned I = 0; I < NumWorkers; ++I)
+        Done.push_back(Pool.async([&, I] {
+            work(Expr, Rows, Results, Shares.get(), NumWorkers, I);
+        }));
+    for (std::shared_future<void> &F : Done)
+        F.wait();
+}
@@ -0,0 +1,46 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include "LibCalc.hpp"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include <cstdint>
+
+// Evaluates a compiled expression over many rows of input on all
+// cores. The rows are stored one after the other, each holding the
+// values of the variables in `with` order:
+//
+//   calc::Evaluator Eval;                  // one thread per core
+//   std::vector<int32_t> Rows = ...;       // NumRows * getNumVars()
+//   std::vector<int32_t> Results(NumRows);
+//   Eval.run(*E, Rows, Results);
+//
+// The rows are cut into chunks, and every worker starts on its own
+// contiguous share of them. A worker that runs out of chunks steals
+// the remaining chunks of the others, so uneven progress (a busy core,
+// a page fault) doesn't leave the other cores idle at the end. Each
+// chunk writes its results to its own slice of the result array, so
+// the workers never lock and, since chunks are cache line aligned,
+// never write to the same cache line.
+namespace calc {
+
+class Evaluator {
+    llvm::ThreadPool Pool;
+public:
+    // Uses the given number of worker threads, or one per core if 0
+    explicit Evaluator(unsigned NumThreads = 0);
+
+    unsigned getNumThreads() const { return Pool.getThreadCount(); }
+
+    // Evaluates the expression for every row, storing the result of
+    // row i in Results[i]. Rows must hold Results.size() rows. Small
+    // inputs are evaluated on the calling thread
+    void run(const CompiledExpr &Expr, llvm::ArrayRef<int32_t> Rows,
+             llvm::MutableArrayRef<int32_t> Results);
+};
+
+} // namespace calc
+
+#endif
@@ -1,5 +1,8 @@
 #include "Lexer.hpp"
 
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MathExtras.h"
+
 // These are some helper functions that will
 // help us classify characters
 namespace charinfo {
@@ -36,6 +39,38 @@ namespace charinfo {
     // unsigned type, causing portability problems
 }
 
+// Converting a number with one multiplication per digit is slow for
+// long literals. Instead, we load eight digits at a time into a 64 bit
+// word and combine them in parallel inside the register (SWAR, "SIMD
+// within a register"). The first digit ends up in the lowest byte.
+namespace swar {
+    // Precondition: P points to eight decimal digits
+    LLVM_READONLY inline uint32_t parseEightDigits(const char *P) {
+        uint64_t V = llvm::support::endian::read64le(P);
+        V -= 0x3030303030303030ULL;
+        // Every byte now combines two neighbouring digits: d0*10 + d1, ...
+        V = (V * 10) + (V >> 8);
+        // Pairs are combined into the final value in two multiplications
+        V = (((V & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+             (((V >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32))))
+            >> 32;
+        return static_cast<uint32_t>(V);
+    }
+
+    // Converts the decimal digits in [Begin, End). On overflow
+    // the result saturates at UINT64_MAX
+    uint64_t parseDecimal(const char *Begin, const char *End) {
+        uint64_t Value = 0;
+        for (; End - Begin >= 8; Begin += 8)
+            Value = llvm::SaturatingMultiplyAdd<uint64_t>(
+                Value, 100000000, parseEightDigits(Begin));
+        for (; Begin != End; ++Begin)
+            Value = llvm::SaturatingMultiplyAdd<uint64_t>(
+                Value, 10, *Begin - '0');
+        return Value;
+    }
+}
+
 void Lexer::next(Token &token) {
     // While there is still more to read
     // from the buffer and the current character
@@ -72,6 +107,7 @@ void Lexer::next(Token &token) {
         const char *end = BufferPtr + 1;
         while (charinfo::isDigit(*end))
             ++end;
+        token.IntValue = swar::parseDecimal(BufferPtr, end);
         formToken(token, end, Token::number);
         return;
     } else {
@@ -99,4 +135,5 @@ void Lexer::formToken(Token &Tok, const char *TokEnd, Token::TokenKind Kind) {
     // the pointer to the next unprocessed character
     Tok.Kind = Kind;
     Tok.Text = llvm::StringRef(BufferPtr, TokEnd - BufferPtr);
+    BufferPtr = TokEnd;
 }
\ No newline at end of file
@@ -4,6 +4,9 @@
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/MemoryBuffer.h"
 
+#include <cassert>
+#include <cstdint>
+
 // The `llvm::MemoryBuffer` class provides read-only access
 // to a block of memory, filled with the content of a file.
 // On request, a trailing zero character ('\x00') is added
@@ -40,9 +43,15 @@ private:
     llvm::StringRef Text; // Points to the start of the text of the token
                           // helpful for semantic processing (ex. for identifier,
                           // useful to know the name)
+    uint64_t IntValue;    // Value of a number, converted once by the lexer.
+                          // Saturates at UINT64_MAX if the literal is too big
 public:
     TokenKind getKind() const { return Kind; }
     llvm::StringRef getText() const { return Text; }
+    uint64_t getIntValue() const {
+        assert(Kind == number && "Not a number");
+        return IntValue;
+    }
 
     bool is(TokenKind K) const { return Kind == K; }
     bool isOneOf(TokenKind K1, TokenKind K2) const {
@@ -0,0 +1,387 @@
+#include "LibCalc.hpp"
+#include "CodeGen.hpp"
+#include "Parser.hpp"
+#include "RecursiveASTVisitor.h"
+#include "Sema.hpp"
+#ifdef CALC_HAVE_STENCILS
+#include "StencilCompiler.hpp"
+#endif
+
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/Object/SymbolSize.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+#include "llvm/TargetParser/Host.h"
+#include "llvm/TargetParser/Triple.h"
+
+#include <cstdlib>
+#include <mutex>
+
+using namespace llvm;
+using namespace calc;
+
+namespace {
+// Appends the functions of every object loaded by the JIT to
+// /tmp/perf-<pid>.map, with one "<start> <size> <name>" line each,
+// in hex. This is the format `perf` uses to symbolize code which has
+// no backing file
+class PerfMapListener : public JITEventListener {
+    std::mutex Lock;
+    std::unique_ptr<raw_fd_ostream> OS;
+public:
+    PerfMapListener() {
+        std::error_code EC;
+        std::string Name =
+            "/tmp/perf-" + std::to_string(sys::Process::getProcessId()) + ".map";
+        OS = std::make_unique<raw_fd_ostream>(Name, EC, sys::fs::OF_Append);
+        if (EC) {
+            errs() << "Cannot open " << Name << ": " << EC.message() << "\n";
+            OS.reset();
+        }
+    }
+
+    void notifyObjectLoaded(ObjectKey, const object::ObjectFile &Obj,
+                            const RuntimeDyld::LoadedObjectInfo &L) override {
+        if (!OS)
+            return;
+        // The debug object has the load addresses of the sections
+        object::OwningBinary<object::ObjectFile> DebugObj =
+            L.getObjectForDebug(Obj);
+        if (!DebugObj.getBinary())
+            return;
+        std::lock_guard<std::mutex> Guard(Lock);
+        for (const auto &SymAndSize :
+             object::computeSymbolSizes(*DebugObj.getBinary())) {
+            const object::SymbolRef &Sym = SymAndSize.first;
+            Expected<object::SymbolRef::Type> Type = Sym.getType();
+            Expected<StringRef> Name = Sym.getName();
+            Expected<uint64_t> Addr = Sym.getAddress();
+            if (!Type || !Name || !Addr) {
+                consumeError(Type.takeError());
+                consumeError(Name.takeError());
+                consumeError(Addr.takeError());
+                continue;
+            }
+            if (*Type == object::SymbolRef::ST_Function && SymAndSize.second)
+                *OS << format("%llx %llx %s\n", (unsigned long long)*Addr,
+                              (unsigned long long)SymAndSize.second,
+                              Name -> str().c_str());
+        }
+        OS -> flush();
+    }
+};
+
+// Everything compiled so far, keyed by the source text. StringMap
+// entries never move, so handles can point into them
+struct CacheEntry {
+    CompiledExpr::FunctionTy Fn = nullptr;
+    std::vector<std::string> VarNames;
+};
+
+// A compiled kernel, keyed by its expressions separated by null
+// characters, which can't occur in an expression
+struct KernelEntry {
+    CompiledKernel::FunctionTy Fn = nullptr;
+    std::vector<std::string> InputNames;
+    unsigned NumOutputs = 0;
+};
+
+// Parses and checks an expression. The tree points into Input, which
+// is null terminated as the lexer requires
+Expected<AST *> parseChecked(const std::string &Input) {
+    Lexer Lex(Input);
+    Parser Parser(Lex);
+    AST *Tree = Parser.parse();
+    if (!Tree || Parser.hasError()) {
+        TreeDeleter().traverse(Tree);
+        return createStringError(inconvertibleErrorCode(),
+                                 "Syntax errors occured");
+    }
+    if (Sema().semantic(Tree)) {
+        TreeDeleter().traverse(Tree);
+        return createStringError(inconvertibleErrorCode(),
+                                 "Semantic errors occured");
+    }
+    return Tree;
+}
+
+// The process wide JIT. The generated code is never removed, which
+// keeps every handed out CompiledExpr valid
+class Engine {
+    std::mutex Lock;
+    std::unique_ptr<orc::LLJIT> JIT;
+    StringMap<CacheEntry> Cache;
+    StringMap<KernelEntry> Kernels;
+    // Names of the generated functions
+    StringSet<> Names;
+
+    // The object layer of the JIT, and the listeners for `perf`
+    // registered with it, if enabled
+    orc::RTDyldObjectLinkingLayer *ObjLayer = nullptr;
+    bool PerfEnabled = false;
+    JITEventListener *PerfJITListener = nullptr; // A static of LLVM
+    std::unique_ptr<PerfMapListener> PerfMap;
+
+    // Without an ELF object layer, there is nothing to listen to
+    void registerPerfListeners() {
+        if (!ObjLayer)
+            return;
+        PerfJITListener = JITEventListener::createPerfJITEventListener();
+        if (PerfJITListener)
+            ObjLayer -> registerJITEventListener(*PerfJITListener);
+        PerfMap = std::make_unique<PerfMapListener>();
+        ObjLayer -> registerJITEventListener(*PerfMap);
+    }
+
+    Error initialize() {
+        if (JIT)
+            return Error::success();
+        InitializeNativeTarget();
+        InitializeNativeTargetAsmPrinter();
+        orc::LLJITBuilder Builder;
+        // The default object layer on ELF, but created here to register
+        // the event listeners with it. Elsewhere, e.g. on Mach-O where
+        // LLJIT links with JITLink, perf support isn't available anyway,
+        // so LLJIT keeps its own
+        if (Triple(sys::getProcessTriple()).isOSBinFormatELF())
+            Builder.setObjectLinkingLayerCreator([this](orc::ExecutionSession &ES,
+                                                        const Triple &) {
+                auto Layer = std::make_unique<orc::RTDyldObjectLinkingLayer>(
+                    ES, [] { return std::make_unique<SectionMemoryManager>(); });
+                ObjLayer = Layer.get();
+                return Expected<std::unique_ptr<orc::ObjectLayer>>(std::move(Layer));
+            });
+        auto JITOrErr = Builder.create();
+        if (!JITOrErr)
+            return JITOrErr.takeError();
+        JIT = std::move(*JITOrErr);
+        if (const char *Env = std::getenv("CALC_PERF"))
+            PerfEnabled |= StringRef(Env) == "1";
+        if (PerfEnabled)
+            registerPerfListeners();
+        return Error::success();
+    }
+
+    // The baseline compiler doesn't use the JIT, and has a lock of
+    // its own, so it doesn't wait for the backend
+    std::mutex BaselineLock;
+    StringMap<CacheEntry> BaselineCache;
+
+    Expected<CacheEntry> build(StringRef Text);
+    Expected<CacheEntry> buildBaseline(StringRef Text);
+    Expected<KernelEntry> buildKernel(ArrayRef<StringRef> Exprs, StringRef Key);
+    std::string getFunctionName(StringRef Prefix, StringRef Text);
+    Expected<orc::ExecutorAddr> addModule(std::unique_ptr<Module> M,
+                                          std::unique_ptr<LLVMContext> Ctx,
+                                          StringRef Name);
+
+public:
+    // The JIT notifies the listeners when it frees the code, but LLVM
+    // may already have destroyed its listener at that point
+    ~Engine() {
+        if (PerfJITListener)
+            ObjLayer -> unregisterJITEventListener(*PerfJITListener);
+        if (PerfMap)
+            ObjLayer -> unregisterJITEventListener(*PerfMap);
+    }
+
+    Expected<CompiledExpr> compile(StringRef Expr);
+    Expected<CompiledExpr> compileBaseline(StringRef Expr);
+    Expected<CompiledKernel> compileKernel(ArrayRef<StringRef> Exprs);
+    void enablePerfSupport();
+};
+
+// The name is derived from the text only, so the same expression
+// has the same symbol in every run, and profiles can be compared.
+// Hash collisions get a suffix
+std::string Engine::getFunctionName(StringRef Prefix, StringRef Text) {
+    SmallString<32> Name(Prefix);
+    raw_svector_ostream(Name) << format_hex_no_prefix(xxHash64(Text), 16);
+    std::string Unique = Name.str().str();
+    for (unsigned I = 1; !Names.insert(Unique).second; ++I)
+        Unique = (Name + "_" + Twine(I)).str();
+    return Unique;
+}
+
+void Engine::enablePerfSupport() {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (PerfEnabled)
+        return;
+    PerfEnabled = true;
+    if (JIT)
+        registerPerfListeners();
+}
+
+Expected<orc::ExecutorAddr> Engine::addModule(std::unique_ptr<Module> M,
+                                              std::unique_ptr<LLVMContext> Ctx,
+                                              StringRef Name) {
+    if (Error Err = JIT -> addIRModule(
+            orc::ThreadSafeModule(std::move(M), std::move(Ctx))))
+        return Err;
+    return JIT -> lookup(Name);
+}
+
+Expected<CacheEntry> Engine::build(StringRef Text) {
+    // The tokens and the tree point into this copy
+    std::string Input = Text.str();
+    Expected<AST *> TreeOrErr = parseChecked(Input);
+    if (!TreeOrErr)
+        return TreeOrErr.takeError();
+    AST *Tree = *TreeOrErr;
+
+    CacheEntry Entry;
+    if (auto *Decl = dyn_cast<WithDecl>(Tree))
+        for (StringRef Var : *Decl)
+            Entry.VarNames.push_back(Var.str());
+
+    std::string Name = getFunctionName("calc_expr_", Text);
+    auto Ctx = std::make_unique<LLVMContext>();
+    std::unique_ptr<Module> M = CodeGen().generateFunction(Tree, *Ctx, Name);
+    TreeDeleter().traverse(Tree);
+
+    Expected<orc::ExecutorAddr> Addr = addModule(std::move(M), std::move(Ctx), Name);
+    if (!Addr)
+        return Addr.takeError();
+    Entry.Fn = Addr -> toPtr<CompiledExpr::FunctionTy>();
+    return Entry;
+}
+
+#ifdef CALC_HAVE_STENCILS
+Expected<CacheEntry> Engine::buildBaseline(StringRef Text) {
+    std::string Input = Text.str();
+    Expected<AST *> TreeOrErr = parseChecked(Input);
+    if (!TreeOrErr)
+        return TreeOrErr.takeError();
+    AST *Tree = *TreeOrErr;
+
+    CacheEntry Entry;
+    if (auto *Decl = dyn_cast<WithDecl>(Tree))
+        for (StringRef Var : *Decl)
+            Entry.VarNames.push_back(Var.str());
+    Expected<StencilCompiler::FunctionTy> Fn = StencilCompiler::compile(Tree);
+    TreeDeleter().traverse(Tree);
+    if (!Fn)
+        return Fn.takeError();
+    Entry.Fn = *Fn;
+    return Entry;
+}
+#endif
+
+Expected<KernelEntry> Engine::buildKernel(ArrayRef<StringRef> Exprs,
+                                          StringRef Key) {
+    std::vector<std::string> Inputs(Exprs.begin(), Exprs.end());
+    SmallVector<AST *, 16> Trees;
+    auto DeleteTrees = make_scope_exit([&] {
+        for (AST *Tree : Trees)
+            TreeDeleter().traverse(Tree);
+    });
+
+    // The inputs of the kernel are the variables of all expressions
+    KernelEntry Entry;
+    StringSet<> Seen;
+    SmallVector<StringRef, 16> InputNames;
+    for (const std::string &Input : Inputs) {
+        Expected<AST *> Tree = parseChecked(Input);
+        if (!Tree)
+            return Tree.takeError();
+        Trees.push_back(*Tree);
+        if (auto *Decl = dyn_cast<WithDecl>(*Tree))
+            for (StringRef Var : *Decl)
+                if (Seen.insert(Var).second)
+                    InputNames.push_back(Var);
+    }
+    for (StringRef Var : InputNames)
+        Entry.InputNames.push_back(Var.str());
+    Entry.NumOutputs = Trees.size();
+
+    std::string Name = getFunctionName("calc_kernel_", Key);
+    auto Ctx = std::make_unique<LLVMContext>();
+    std::unique_ptr<Module> M =
+        CodeGen().generateKernel(Trees, InputNames, *Ctx, Name);
+    Expected<orc::ExecutorAddr> Addr = addModule(std::move(M), std::move(Ctx), Name);
+    if (!Addr)
+        return Addr.takeError();
+    Entry.Fn = Addr -> toPtr<CompiledKernel::FunctionTy>();
+    return Entry;
+}
+
+Expected<CompiledExpr> Engine::compile(StringRef Expr) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    auto It = Cache.find(Expr);
+    if (It == Cache.end()) {
+        if (Error Err = initialize())
+            return Err;
+        Expected<CacheEntry> Entry = build(Expr);
+        if (!Entry)
+            return Entry.takeError();
+        It = Cache.try_emplace(Expr, std::move(*Entry)).first;
+    }
+    return CompiledExpr(It -> second.Fn, It -> second.VarNames);
+}
+
+Expected<CompiledExpr> Engine::compileBaseline(StringRef Expr) {
+#ifndef CALC_HAVE_STENCILS
+    return compile(Expr);
+#else
+    std::lock_guard<std::mutex> Guard(BaselineLock);
+    auto It = BaselineCache.find(Expr);
+    if (It == BaselineCache.end()) {
+        Expected<CacheEntry> Entry = buildBaseline(Expr);
+        if (!Entry)
+            return Entry.takeError();
+        It = BaselineCache.try_emplace(Expr, std::move(*Entry)).first;
+    }
+    return CompiledExpr(It -> second.Fn, It -> second.VarNames);
+#endif
+}
+
+Expected<CompiledKernel> Engine::compileKernel(ArrayRef<StringRef> Exprs) {
+    std::string Key;
+    for (StringRef Expr : Exprs) {
+        Key += Expr;
+        Key += '\0';
+    }
+    std::lock_guard<std::mutex> Guard(Lock);
+    auto It = Kernels.find(Key);
+    if (It == Kernels.end()) {
+        if (Error Err = initialize())
+            return Err;
+        Expected<KernelEntry> Entry = buildKernel(Exprs, Key);
+        if (!Entry)
+            return Entry.takeError();
+        It = Kernels.try_emplace(Key, std::move(*Entry)).first;
+    }
+    return CompiledKernel(It -> second.Fn, It -> second.InputNames,
+                          It -> second.NumOutputs);
+}
+} // namespace
+
+static Engine &getEngine() {
+    static Engine TheEngine;
+    return TheEngine;
+}
+
+Expected<calc::CompiledExpr> calc::compile(StringRef Expr) {
+    return getEngine().compile(Expr);
+}
+
+Expected<calc::CompiledExpr> calc::compileBaseline(StringRef Expr) {
+    return getEngine().compileBaseline(Expr);
+}
+
+Expected<calc::CompiledKernel> calc::compileKernel(ArrayRef<StringRef> Exprs) {
+    return getEngine().compileKernel(Exprs);
+}
+
+void calc::enablePerfSupport() { getEngine().enablePerfSupport(); }
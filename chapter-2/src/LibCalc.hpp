@@ -0,0 +1,130 @@
+#ifndef LIBCALC_H
+#define LIBCALC_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// libcalc embeds the calc compiler into other programs. An expression
+// goes through the same Lexer, Parser, Sema and CodeGen pipeline as
+// in the `calc` driver, but instead of a `main()` calling the runtime
+// library, a function taking the variable values is generated and
+// compiled to native code in the process:
+//
+//   llvm::Expected<calc::CompiledExpr> E = calc::compile("with a,b: a*(b+3)");
+//   if (!E) { ... }
+//   int32_t Values[] = {2, 4};
+//   int32_t Result = (*E)(Values); // 14
+
+namespace calc {
+
+// A compiled expression. This is only a small handle to native code
+// which lives as long as the process, so it can be copied freely and
+// called from any number of threads at the same time without locking.
+class CompiledExpr {
+public:
+    using FunctionTy = int32_t (*)(const int32_t *Values);
+private:
+    FunctionTy Fn = nullptr;
+    const std::vector<std::string> *VarNames = nullptr;
+public:
+    CompiledExpr() = default;
+    CompiledExpr(FunctionTy Fn, const std::vector<std::string> &VarNames)
+        : Fn(Fn), VarNames(&VarNames) {}
+
+    explicit operator bool() const { return Fn != nullptr; }
+
+    // Evaluates the expression. Values[i] is the value of the i-th
+    // variable in the `with` list
+    int32_t operator()(const int32_t *Values) const { return Fn(Values); }
+
+    FunctionTy getFunction() const { return Fn; }
+
+    // The names of the variables, in `with` order
+    llvm::ArrayRef<std::string> getVarNames() const { return *VarNames; }
+    unsigned getNumVars() const { return VarNames -> size(); }
+};
+
+// Several expressions compiled into one function, a "kernel", which
+// computes all of them for the same inputs at once. A variable with
+// the same name is the same input in all expressions:
+//
+//   const llvm::StringRef Exprs[] = {"with a,b: (a+b)*2", "with b,a,c: (b+a)*c"};
+//   llvm::Expected<calc::CompiledKernel> K = calc::compileKernel(Exprs);
+//   // K -> getInputNames() is {"a", "b", "c"}
+//   (*K)(Inputs, Outputs);         // Outputs[i] is the value of Exprs[i],
+//                                  // and a+b is computed once
+//
+// Every input is loaded once, and subexpressions occuring in several
+// expressions (or several times in one) are computed once, so the
+// cost per call grows with the distinct work of all expressions, not
+// with their number. Like `CompiledExpr`, this is a small handle
+class CompiledKernel {
+public:
+    using FunctionTy = void (*)(const int32_t *Inputs, int32_t *Outputs);
+private:
+    FunctionTy Fn = nullptr;
+    const std::vector<std::string> *InputNames = nullptr;
+    unsigned NumOutputs = 0;
+public:
+    CompiledKernel() = default;
+    CompiledKernel(FunctionTy Fn, const std::vector<std::string> &InputNames,
+                   unsigned NumOutputs)
+        : Fn(Fn), InputNames(&InputNames), NumOutputs(NumOutputs) {}
+
+    explicit operator bool() const { return Fn != nullptr; }
+
+    // Evaluates all expressions. Inputs[i] is the value of the i-th
+    // input, and the value of the i-th expression is stored in
+    // Outputs[i]
+    void operator()(const int32_t *Inputs, int32_t *Outputs) const {
+        Fn(Inputs, Outputs);
+    }
+
+    FunctionTy getFunction() const { return Fn; }
+
+    // The union of the `with` lists, in order of first appearance
+    llvm::ArrayRef<std::string> getInputNames() const { return *InputNames; }
+    unsigned getNumInputs() const { return InputNames -> size(); }
+    unsigned getNumOutputs() const { return NumOutputs; }
+};
+
+// Compiles an expression to native code. Compiling the same text
+// again returns the handle compiled the first time. Can be called
+// from several threads; compilations are serialized internally.
+// Syntax and semantic errors are printed to stderr, like in the
+// driver, and reported as an error.
+llvm::Expected<CompiledExpr> compile(llvm::StringRef Expr);
+
+// Like `compile()`, but with the baseline compiler (see
+// StencilCompiler.hpp), which generates code without LLVM's backend
+// in microseconds instead of milliseconds. The code is slower, as
+// it's not optimized, but computes the same results. Suited for
+// expressions which are only evaluated a few times. Expressions have
+// a cache of their own, so the same text may be compiled with both.
+// Where the baseline compiler isn't supported, this is `compile()`
+llvm::Expected<CompiledExpr> compileBaseline(llvm::StringRef Expr);
+
+// Compiles several expressions into one kernel. Like `compile()`,
+// the same list of expressions is only compiled once
+llvm::Expected<CompiledKernel> compileKernel(llvm::ArrayRef<llvm::StringRef> Exprs);
+
+// Makes the code compiled from now on visible to Linux `perf`. Every
+// expression is compiled into a function named after a hash of its
+// text, `calc_expr_<hash>` (`calc_kernel_<hash>` for a kernel), so
+// it has the same name in every run. The symbols are appended to
+// /tmp/perf-<pid>.map, which `perf report` reads on its own, and the
+// code is also written to a jitdump file (in $JITDUMPDIR or
+// ~/.debug/jit) for `perf record -k 1` followed by `perf inject
+// --jit`. Setting the environment variable CALC_PERF to 1 has the
+// same effect. Only ELF platforms are supported; elsewhere this does
+// nothing.
+void enablePerfSupport();
+
+} // namespace calc
+
+#endif
@@ -0,0 +1,93 @@
+#include "Memoizer.hpp"
+
+#include "llvm/Support/MathExtras.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+using namespace llvm;
+using namespace calc;
+
+namespace {
+// Mixes the values of a tuple into a 64 bit hash. The lower bits
+// select the slot, the upper half is kept as a tag, so most
+// mismatches are detected without comparing the tuples
+uint64_t hashTuple(const int32_t *Values, unsigned NumVars) {
+    uint64_t H = 0x9E3779B97F4A7C15ULL;
+    for (unsigned I = 0; I < NumVars; ++I) {
+        H ^= uint32_t(Values[I]);
+        H *= 0xBF58476D1CE4E5B9ULL;
+        H ^= H >> 31;
+    }
+    return H;
+}
+} // namespace
+
+Memoizer::Memoizer(const CompiledExpr &Expr, size_t Capacity)
+    : Expr(Expr), NumVars(Expr.getNumVars()) {
+    assert(Expr && "Memoizing an empty CompiledExpr");
+    Capacity = PowerOf2Ceil(std::max<size_t>(Capacity, ProbeLength));
+    Mask = Capacity - 1;
+    Slots.reset(new Slot[Capacity]);
+    Keys.reset(new int32_t[Capacity * NumVars]);
+    clear();
+}
+
+void Memoizer::clear() {
+    std::fill_n(Slots.get(), getCapacity(), Slot{0, 0, 0});
+    Statistics = Stats();
+}
+
+bool Memoizer::matches(size_t I, const int32_t *Values) {
+    return std::memcmp(getKey(I), Values, NumVars * sizeof(int32_t)) == 0;
+}
+
+int32_t Memoizer::insert(size_t I, uint32_t Tag, const int32_t *Values) {
+    ++Statistics.Misses;
+    std::memcpy(getKey(I), Values, NumVars * sizeof(int32_t));
+    Slots[I] = Slot{Tag, 1, Expr(Values)};
+    return Slots[I].Result;
+}
+
+int32_t Memoizer::operator()(const int32_t *Values) {
+    uint64_t Hash = hashTuple(Values, NumVars);
+    // Tag 0 marks a free slot
+    uint32_t Tag = uint32_t(Hash >> 32) | 1;
+
+    // Entries are replaced, but never removed, so a tuple which is
+    // in the table is always found before the first free slot
+    size_t Victim = Hash & Mask;
+    for (unsigned Probe = 0; Probe < ProbeLength; ++Probe) {
+        size_t I = (Hash + Probe) & Mask;
+        Slot &S = Slots[I];
+        if (S.Tag == 0)
+            return insert(I, Tag, Values);
+        if (S.Tag == Tag && matches(I, Values)) {
+            ++Statistics.Hits;
+            if (S.Uses != UINT32_MAX)
+                ++S.Uses;
+            return S.Result;
+        }
+        if (S.Uses < Slots[Victim].Uses)
+            Victim = I;
+    }
+
+    // The window is full: replace its least used entry, and age the
+    // others
+    ++Statistics.Evictions;
+    for (unsigned Probe = 0; Probe < ProbeLength; ++Probe)
+        Slots[(Hash + Probe) & Mask].Uses /= 2;
+    return insert(Victim, Tag, Values);
+}
+
+void Memoizer::run(ArrayRef<int32_t> Rows, MutableArrayRef<int32_t> Results) {
+    assert(Rows.size() == Results.size() * NumVars &&
+           "Rows don't match the number of results");
+    const int32_t *Values = Rows.data();
+    for (int32_t &Result : Results) {
+        Result = (*this)(Values);
+        Values += NumVars;
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef MEMOIZER_H
+#define MEMOIZER_H
+
+#include "LibCalc.hpp"
+
+#include "llvm/ADT/ArrayRef.h"
+
+#include <cstdint>
+#include <memory>
+
+// Remembers the results of a compiled expression for the input
+// tuples it has seen, so that rows repeating a combination of
+// variable values skip the evaluation:
+//
+//   calc::Memoizer Memo(*E);               // 64K entries
+//   Memo.run(Rows, Results);               // like Evaluator::run()
+//   double Rate = Memo.getStats().hitRate();
+//
+// The table is a fixed size open addressing hash table, so memory
+// use is bounded no matter how many distinct tuples the input has.
+// A tuple is stored in the first free slot of a window of ProbeLength
+// slots after its hash. Once the window is full, a new tuple replaces
+// the entry which was used least often. Every eviction also halves
+// the use counts of the window, so entries which were hot a while
+// ago eventually make room. With a skewed distribution the frequent
+// tuples thus stay in the table, while the long tail of rare tuples
+// only competes for the remaining slots, instead of flushing it like
+// in an LRU cache.
+//
+// A lookup hashes and compares the whole tuple, so this only pays
+// off when evaluating the expression costs more than that, and the
+// hit rate is high. Check the statistics before enabling it.
+//
+// A Memoizer is not thread safe; use one per thread.
+namespace calc {
+
+class Memoizer {
+public:
+    static constexpr unsigned ProbeLength = 8;
+
+    struct Stats {
+        uint64_t Hits = 0;
+        uint64_t Misses = 0;
+        uint64_t Evictions = 0;
+
+        double hitRate() const {
+            uint64_t Lookups = Hits + Misses;
+            return Lookups ? double(Hits) / Lookups : 0.0;
+        }
+    };
+
+private:
+    struct Slot {
+        uint32_t Tag; // Upper half of the hash, 0 if the slot is free
+        uint32_t Uses; // Aged use count, for eviction
+        int32_t Result;
+    };
+
+    CompiledExpr Expr;
+    unsigned NumVars;
+    size_t Mask;
+    std::unique_ptr<Slot[]> Slots;
+    // The tuple of slot I starts at Keys[I * NumVars]
+    std::unique_ptr<int32_t[]> Keys;
+    Stats Statistics;
+
+    int32_t *getKey(size_t I) { return Keys.get() + I * NumVars; }
+    bool matches(size_t I, const int32_t *Values);
+    int32_t insert(size_t I, uint32_t Tag, const int32_t *Values);
+
+public:
+    // Creates a table for Capacity tuples, rounded up to a power of
+    // two, and at least ProbeLength
+    explicit Memoizer(const CompiledExpr &Expr, size_t Capacity = 1 << 16);
+
+    // Returns the value of the expression for the tuple Values,
+    // evaluating it only if the tuple is not in the table
+    int32_t operator()(const int32_t *Values);
+
+    // Evaluates the expression for every row, storing the result of
+    // row i in Results[i]. Rows must hold Results.size() rows
+    void run(llvm::ArrayRef<int32_t> Rows,
+             llvm::MutableArrayRef<int32_t> Results);
+
+    // Forgets all tuples and resets the statistics
+    void clear();
+
+    size_t getCapacity() const { return Mask + 1; }
+    const Stats &getStats() const { return Statistics; }
+};
+
+} // namespace calc
+
+#endif
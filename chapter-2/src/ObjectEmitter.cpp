@@ -0,0 +1,96 @@
+#include "ObjectEmitter.hpp"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/CodeGen/ParallelCG.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/TargetParser/Host.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+// Links the objects in Inputs into the relocatable object Output
+Error linkObjects(ArrayRef<SmallString<128>> Inputs, StringRef Output) {
+    ErrorOr<std::string> Ld = sys::findProgramByName("ld");
+    if (!Ld)
+        return createStringError(Ld.getError(), "Linker ld not found");
+    SmallVector<StringRef, 8> Args = {*Ld, "-r", "-o", Output};
+    for (const SmallString<128> &Input : Inputs)
+        Args.push_back(Input);
+    std::string Message;
+    if (sys::ExecuteAndWait(*Ld, Args, std::nullopt, {}, 0, 0, &Message))
+        return createStringError(inconvertibleErrorCode(),
+                                 "Linking the partitions failed: " + Message);
+    return Error::success();
+}
+} // namespace
+
+Error ObjectEmitter::emit(Module &M, StringRef FileName) {
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    std::string Triple = sys::getProcessTriple();
+    std::string Message;
+    const Target *T = TargetRegistry::lookupTarget(Triple, Message);
+    if (!T)
+        return createStringError(inconvertibleErrorCode(), Message);
+    // The partitions are compiled on different threads, so each
+    // needs its own target machine. Position independent code links
+    // into any executable
+    auto CreateTM = [&] {
+        return std::unique_ptr<TargetMachine>(T -> createTargetMachine(
+            Triple, "generic", "", TargetOptions(), Reloc::PIC_));
+    };
+    std::unique_ptr<TargetMachine> TM = CreateTM();
+    M.setTargetTriple(Triple);
+    M.setDataLayout(TM -> createDataLayout());
+
+    // More partitions than functions would only be empty
+    size_t NumFunctions = count_if(M, [](Function &F) { return !F.isDeclaration(); });
+    unsigned NumParts = std::min<size_t>(
+        hardware_concurrency(NumThreads).compute_thread_count(), NumFunctions);
+
+    if (NumParts <= 1) {
+        std::error_code EC;
+        raw_fd_ostream OS(FileName, EC, sys::fs::OF_None);
+        if (EC)
+            return createStringError(EC, "Cannot open " + FileName);
+        legacy::PassManager PM;
+        if (TM -> addPassesToEmitFile(PM, OS, nullptr, CGFT_ObjectFile))
+            return createStringError(inconvertibleErrorCode(),
+                                     "The target can't emit object files");
+        PM.run(M);
+        return Error::success();
+    }
+
+    // Every partition is written to a temporary object, which is
+    // removed once it is linked
+    SmallVector<SmallString<128>, 8> TempNames(NumParts);
+    std::vector<std::unique_ptr<FileRemover>> Removers;
+    std::vector<std::unique_ptr<raw_fd_ostream>> Streams;
+    SmallVector<raw_pwrite_stream *, 8> OSs;
+    for (SmallString<128> &Name : TempNames) {
+        int FD;
+        if (std::error_code EC =
+                sys::fs::createTemporaryFile("calc", "o", FD, Name))
+            return createStringError(EC, "Cannot create a temporary file");
+        Removers.push_back(std::make_unique<FileRemover>(Name));
+        Streams.push_back(std::make_unique<raw_fd_ostream>(FD, true));
+        OSs.push_back(Streams.back().get());
+    }
+    splitCodeGen(M, OSs, {}, CreateTM);
+    Streams.clear();
+    return linkObjects(TempNames, FileName);
+}
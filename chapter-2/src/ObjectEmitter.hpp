@@ -0,0 +1,29 @@
+#ifndef OBJECT_EMITTER_H
+#define OBJECT_EMITTER_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+
+// Compiles a module to an object file for the host, instead of
+// piping the IR through `llc`. A module with several functions, like
+// a huge expression split by `CodeGen::setMaxFunctionSize()`, is
+// split into one partition per thread, and the partitions are
+// compiled in parallel (see llvm::splitCodeGen()). The objects of
+// the partitions are then linked into one relocatable object with
+// `ld -r`, so the result can be used like the output of `llc`:
+//
+//   ObjectEmitter Emitter;                 // one thread per core
+//   if (llvm::Error Err = Emitter.emit(*M, "expr.o")) { ... }
+class ObjectEmitter {
+    unsigned NumThreads;
+public:
+    // Uses the given number of threads, or one per core if 0
+    explicit ObjectEmitter(unsigned NumThreads = 0) : NumThreads(NumThreads) {}
+
+    // Writes the object file FileName. The target triple and data
+    // layout of M are set to the ones of the host
+    llvm::Error emit(llvm::Module &M, llvm::StringRef FileName);
+};
+
+#endif
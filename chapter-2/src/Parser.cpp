@@ -1,14 +1,49 @@
 #include "Parser.hpp"
 
+namespace {
+// The default actions, building the AST
+class ASTBuilder : public ParserActions {
+    llvm::SmallVector<llvm::StringRef, 8> Vars;
+    AST *Tree = nullptr;
+public:
+    AST *getTree() { return Tree; }
+
+    void actOnWithDecl(llvm::ArrayRef<llvm::StringRef> Vars) override {
+        this -> Vars.assign(Vars.begin(), Vars.end());
+    }
+    ExprHandle actOnNumber(llvm::StringRef Text, int32_t Value) override {
+        return new Factor(Factor::Number, Text, Value);
+    }
+    ExprHandle actOnIdent(llvm::StringRef Name) override {
+        return new Factor(Factor::Ident, Name);
+    }
+    ExprHandle actOnBinaryOp(BinaryOp::Operator Op, ExprHandle Left,
+                             ExprHandle Right) override {
+        return new BinaryOp(Op, static_cast<Expr *>(Left),
+                            static_cast<Expr *>(Right));
+    }
+    // The collected information is now used to create
+    // the AST node for the whole input
+    void actOnCalc(ExprHandle E) override {
+        if (Vars.empty()) Tree = static_cast<Expr *>(E);
+        else Tree = new WithDecl(Vars, static_cast<Expr *>(E));
+    }
+};
+} // namespace
+
 AST *Parser::parse() {
-    AST *Res = parseCalc();
-    expect(Token::eoi);
-    return Res;
+    ASTBuilder Builder;
+    parse(Builder);
+    return Builder.getTree();
 }
 
-AST *Parser::parseCalc() {
-    Expr *E;
+void Parser::parse(ParserActions &Actions) {
+    this -> Actions = &Actions;
+    parseCalc();
+    expect(Token::eoi);
+}
 
+void Parser::parseCalc() {
     // We use LLVM's optimized "small" vector
     // instead of the standard lib. vector here
     llvm::SmallVector<llvm::StringRef, 8> Vars;
@@ -18,40 +53,38 @@ AST *Parser::parseCalc() {
     // group begins with the 'with' token, so
     // let's compare the token to this val.
 
-    if (Tok.is(Token::KW_with))
-        advance();
-    
-    // Next, we expect an ident.
-    if (expect(Token::ident))
-        goto _error;
-    
-    // If there _is_ an identifier, then we
-    // save it in the `Vars` vector. Otherwise,
-    // it is a syntax error, handled sperately
-    Vars.push_back(Tok.getText());
-    advance();
-
-    // Next follows a repeating group that
-    // parses more identifiers, separated by commas
-    while (Tok.is(Token::comma)) {
+    if (Tok.is(Token::KW_with)) {
         advance();
+
+        // Next, we expect an ident.
         if (expect(Token::ident))
             goto _error;
+
+        // If there _is_ an identifier, then we
+        // save it in the `Vars` vector. Otherwise,
+        // it is a syntax error, handled sperately
         Vars.push_back(Tok.getText());
         advance();
-    }
 
-    // Finally, the optional group requires a
-    // colon at the end
-    if (consume(Token::colon))
-        goto _error;
-    
-    E = parseExpr();
+        // Next follows a repeating group that
+        // parses more identifiers, separated by commas
+        while (Tok.is(Token::comma)) {
+            advance();
+            if (expect(Token::ident))
+                goto _error;
+            Vars.push_back(Tok.getText());
+            advance();
+        }
 
-    // The collected information is now used to create
-    // the AST node for this rule
-    if (Vars.empty()) return E;
-    else return new WithDecl(Vars, E);
+        // Finally, the optional group requires a
+        // colon at the end
+        if (consume(Token::colon))
+            goto _error;
+        Actions -> actOnWithDecl(Vars);
+    }
+
+    Actions -> actOnCalc(parseExpr());
+    return;
 
 // We will use "panic mode" to recover from syntax errors
 // In panic mode, tokens are deleted from the token stream
@@ -63,51 +96,134 @@ AST *Parser::parseCalc() {
 _error:
     while(!Tok.is(Token::eoi))
         advance();
-    return nullptr;
 };
 
-Expr *Parser::parseExpr() {
-    Expr *Left = parseTerm();
-    // The repeated group
-    while (Tok.isOneOf(Token::plus, Token::minus)) {
-        BinaryOp::Operator Op = 
-            Tok.is(Token::plus) ? BinaryOp::Plus : BinaryOp::Minus;
-        advance();
-        Expr *Right = parseTerm();
-        Left = new BinaryOp(Op, Left, Right);
+namespace {
+// An entry of the operator stack used by `parseExpr()`. It is
+// either a binary operator still waiting for its right operand,
+// or an open parenthesis that has not been closed yet
+struct PendingOp {
+    BinaryOp::Operator Op;
+    bool IsParen;
+};
+
+// Multiplicative operators bind tighter than additive ones. All
+// operators are left associative
+unsigned getPrecedence(BinaryOp::Operator Op) {
+    return (Op == BinaryOp::Mul || Op == BinaryOp::Div) ? 2 : 1;
+}
+
+bool isBinaryOperator(const Token &Tok) {
+    return Tok.isOneOf(Token::plus, Token::minus,
+                       Token::star, Token::slash);
+}
+
+BinaryOp::Operator getOperator(const Token &Tok) {
+    switch (Tok.getKind()) {
+    case Token::plus: return BinaryOp::Plus;
+    case Token::minus: return BinaryOp::Minus;
+    case Token::star: return BinaryOp::Mul;
+    default: return BinaryOp::Div;
     }
-    return Left;
 }
 
-Expr *Parser::parseTerm() {
-    Expr *Left = parseFactor();
-    while (Tok.isOneOf(Token::star, Token::slash)) {
-        BinaryOp::Operator Op =
-            Tok.is(Token::star) ? BinaryOp::Mul : BinaryOp::Div;
-        advance();
-        Expr *Right = parseFactor();
-        Left = new BinaryOp(Op, Left, Right);
+// Pops the topmost operator and its two operands and pushes
+// the combined expression back
+void reduce(ParserActions &Actions,
+            llvm::SmallVectorImpl<ParserActions::ExprHandle> &Operands,
+            llvm::SmallVectorImpl<PendingOp> &Operators) {
+    ParserActions::ExprHandle Right = Operands.pop_back_val();
+    ParserActions::ExprHandle Left = Operands.pop_back_val();
+    Operands.push_back(
+        Actions.actOnBinaryOp(Operators.pop_back_val().Op, Left, Right));
+}
+} // namespace
+
+// The expression grammar
+//
+//   expr : term (( "+" | "-" ) term)* ;
+//   term : factor (( "*" | "/" ) factor)* ;
+//   factor : ident | number | "(" expr ")" ;
+//
+// is parsed with operator precedence (shunting-yard) instead of one
+// recursive call per rule. Operands and pending operators live on
+// explicit stacks, so the nesting depth of the input is limited only
+// by the heap. The resulting tree is exactly the one the recursive
+// descent version builds.
+ParserActions::ExprHandle Parser::parseExpr() {
+    llvm::SmallVector<ParserActions::ExprHandle, 16> Operands;
+    llvm::SmallVector<PendingOp, 16> Operators;
+    unsigned Depth = 0; // Number of unclosed parentheses
+
+    for (;;) {
+        // Operand position: any number of open parentheses,
+        // followed by a factor
+        while (Tok.is(Token::l_paren)) {
+            Operators.push_back({BinaryOp::Plus, /*IsParen=*/true});
+            ++Depth;
+            advance();
+        }
+        Operands.push_back(parseFactor());
+
+        // Operator position: close parentheses until we find the
+        // next binary operator or the end of the expression
+        for (;;) {
+            if (isBinaryOperator(Tok)) {
+                BinaryOp::Operator Op = getOperator(Tok);
+                while (!Operators.empty() && !Operators.back().IsParen &&
+                       getPrecedence(Operators.back().Op) >= getPrecedence(Op))
+                    reduce(*Actions, Operands, Operators);
+                Operators.push_back({Op, /*IsParen=*/false});
+                advance();
+                break;
+            }
+
+            if (Depth == 0) {
+                while (!Operators.empty())
+                    reduce(*Actions, Operands, Operators);
+                return Operands.pop_back_val();
+            }
+
+            // Still inside a parenthesized group, so a `)` must follow.
+            // If it doesn't, we report the error, skip to a token we can
+            // continue with and treat the group as closed
+            if (consume(Token::r_paren)) {
+                while (!Tok.isOneOf(Token::r_paren, Token::star,
+                                    Token::plus, Token::minus,
+                                    Token::slash, Token::eoi))
+                    advance();
+            }
+            while (!Operators.back().IsParen)
+                reduce(*Actions, Operands, Operators);
+            Operators.pop_back();
+            --Depth;
+        }
     }
-    return Left;
 }
 
-Expr *Parser::parseFactor() {
-    Expr *Res = nullptr;
+// Parses the leaf of an expression. Parenthesized subexpressions
+// are handled by `parseExpr()` itself
+ParserActions::ExprHandle Parser::parseFactor() {
+    ParserActions::ExprHandle Res = nullptr;
     switch (Tok.getKind()) {
     case Token::number:
-        Res = new Factor(Factor::Number, Tok.getText());
+        // The lexer has already converted the number, we
+        // only need to check that it fits into an i32
+        if (Tok.getIntValue() > INT32_MAX) {
+            llvm::errs() << "Number out of range: " << Tok.getText()
+                         << "\n";
+            HasError = true;
+        }
+        Res = Actions -> actOnNumber(Tok.getText(),
+                                     static_cast<int32_t>(Tok.getIntValue()));
         advance();
         break;
     case Token::ident:
-        Res = new Factor(Factor::Ident, Tok.getText());
+        Res = Actions -> actOnIdent(Tok.getText());
         advance();
         break;
-    case Token::l_paren:
-        advance();
-        Res = parseExpr();
-        if (!consume(Token::r_paren)) break;
     default:
-        if (!Res) error();
+        error();
         while (!Tok.isOneOf(Token::r_paren, Token::star,
                             Token::plus, Token::minus,
                             Token::slash, Token::eoi))
@@ -2,16 +2,43 @@
 #define PARSER_H
 
 #include "AST.h"
+#include "AllocStats.hpp"
 #include "Lexer.hpp"
+#include "ThreadedLexer.hpp"
 
 // The coding guidelines from LLVM forbid the use of the <iostream> library
 // Thus, we use the header of the equivalent LLVM functionality
 #include "llvm/Support/raw_ostream.h"
 
+// The parser reports every construct it recognizes to a
+// `ParserActions` object, in evaluation order, much like clang's
+// parser calls into its `Sema`. The default actions build the AST,
+// while `CodeGen::generateStreaming()` emits IR right away, without
+// keeping any tree. Expressions are passed around as opaque handles
+// owned by the actions. A handle is null after a syntax error
+class ParserActions {
+public:
+    using ExprHandle = void *;
+
+    virtual ~ParserActions() {}
+
+    // Called after the `with` list, before the expression
+    virtual void actOnWithDecl(llvm::ArrayRef<llvm::StringRef> /*Vars*/) {}
+    virtual ExprHandle actOnNumber(llvm::StringRef Text, int32_t Value) = 0;
+    virtual ExprHandle actOnIdent(llvm::StringRef Name) = 0;
+    virtual ExprHandle actOnBinaryOp(BinaryOp::Operator Op, ExprHandle Left,
+                                     ExprHandle Right) = 0;
+    // Called with the whole expression, unless the `with` list
+    // already had a syntax error
+    virtual void actOnCalc(ExprHandle /*E*/) {}
+};
+
 class Parser {
     Lexer &Lex; // Used to retrieve the next token from the input
+    std::unique_ptr<ThreadedLexer> Pipe; // Runs `Lex`, if threaded
     Token Tok; // Stores the next token (look-ahead)
     bool HasError; // Indicates whether an error was detected
+    ParserActions *Actions = nullptr; // Receives what is parsed
 
     void error() {
         llvm::errs() << "Unexpected: " << Tok.getText()
@@ -21,7 +48,15 @@ class Parser {
 
     // Retrieves the next token from the lexer (when we say "retrieve",
     // we don't mean it's returning it though)
-    void advance() { Lex.next(Tok); }
+    void advance() {
+        if (Pipe) {
+            // The lexer thread accounts its allocations itself
+            Pipe -> next(Tok);
+            return;
+        }
+        allocstats::Scope InLexer(allocstats::Lexer);
+        Lex.next(Tok);
+    }
 
     // Test whether the look-ahead has the expected kind and
     // emits an error message if not. Sometimes called `match`
@@ -48,22 +83,28 @@ class Parser {
     // by the corresponding token
 
     // (Almost) parsing entrypoint
-    AST *parseCalc();
-    Expr *parseExpr();
-    Expr *parseTerm();
-    Expr *parseFactor();
+    void parseCalc();
+    ParserActions::ExprHandle parseExpr(); // Iterative, see Parser.cpp
+    ParserActions::ExprHandle parseFactor();
 
 public:
     // Initializes all members and retrieves the first
-    // token from the lexer
-    Parser(Lexer &Lex) : Lex(Lex), HasError(false) {
+    // token from the lexer. A threaded lexer runs on its own
+    // thread, concurrently with the parser (see ThreadedLexer.hpp)
+    Parser(Lexer &Lex, bool Threaded = false) : Lex(Lex), HasError(false) {
+        if (Threaded)
+            Pipe = std::make_unique<ThreadedLexer>(Lex);
         advance();
     }
 
     bool hasError() { return HasError; }
 
-    // Parsing entrypoint
+    // Parsing entrypoint, returning the AST
     AST *parse();
+
+    // Parses the input, passing everything to Actions instead
+    // of building an AST
+    void parse(ParserActions &Actions);
 };
 
 #endif
\ No newline at end of file
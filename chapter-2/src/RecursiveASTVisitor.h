@@ -0,0 +1,93 @@
+#ifndef RECURSIVE_AST_VISITOR_H
+#define RECURSIVE_AST_VISITOR_H
+
+#include "AST.h"
+
+#include "llvm/ADT/PointerIntPair.h"
+#include "llvm/ADT/SmallVector.h"
+
+// A statically dispatched alternative to `ASTVisitor`, modelled
+// after clang's RecursiveASTVisitor. The derived class passes itself
+// as the template argument (the "curiously recurring template
+// pattern") and hides the `visit*()` hooks it is interested in:
+//
+//   class Counter : public RecursiveASTVisitor<Counter> {
+//   public:
+//       void visitFactor(Factor &Node) { ... }
+//   };
+//
+// Because the node kind is known from `getNodeKind()` and the hook
+// is resolved at compile time, visiting a node costs a switch
+// instead of two virtual calls, and the hooks can be inlined.
+//
+// Like the other traversals, the tree is walked with an explicit
+// worklist, so its depth is not limited by the call stack. The
+// order is the evaluation order: a `WithDecl` is visited before its
+// expression, a `BinaryOp` after both of its operands (left first).
+// Missing (null) operands are skipped. `enterBinaryOp()` is called
+// before the operands of a `BinaryOp` are traversed, for visitors
+// which need to know where a subtree starts.
+template <typename Derived> class RecursiveASTVisitor {
+    // Nodes still to be traversed. An entry with the flag set is
+    // a `BinaryOp` whose operands have already been traversed
+    llvm::SmallVector<llvm::PointerIntPair<AST *, 1, bool>, 32> Worklist;
+
+    Derived &getDerived() { return *static_cast<Derived *>(this); }
+
+public:
+    void traverse(AST *Tree) {
+        if (Tree)
+            Worklist.push_back({Tree, false});
+        while (!Worklist.empty()) {
+            auto Item = Worklist.pop_back_val();
+            AST *Node = Item.getPointer();
+            switch (Node->getNodeKind()) {
+            case AST::NK_WithDecl: {
+                auto *Decl = llvm::cast<WithDecl>(Node);
+                getDerived().visitWithDecl(*Decl);
+                if (Decl->getExpr())
+                    Worklist.push_back({Decl->getExpr(), false});
+                break;
+            }
+            case AST::NK_Factor:
+                getDerived().visitFactor(*llvm::cast<Factor>(Node));
+                break;
+            case AST::NK_BinaryOp: {
+                auto *Op = llvm::cast<BinaryOp>(Node);
+                if (Item.getInt()) {
+                    getDerived().visitBinaryOp(*Op);
+                    break;
+                }
+                getDerived().enterBinaryOp(*Op);
+                // Operands are popped in reverse order
+                Worklist.push_back({Op, true});
+                if (Op->getRight())
+                    Worklist.push_back({Op->getRight(), false});
+                if (Op->getLeft())
+                    Worklist.push_back({Op->getLeft(), false});
+                break;
+            }
+            }
+        }
+    }
+
+    // Default hooks, doing nothing
+    void visitWithDecl(WithDecl &) {}
+    void visitFactor(Factor &) {}
+    void visitBinaryOp(BinaryOp &) {}
+    void enterBinaryOp(BinaryOp &) {}
+};
+
+// Frees the nodes of a tree, e.g. once the code is generated. A
+// `WithDecl` is freed last, because the traversal reads its
+// expression after visiting it
+class TreeDeleter : public RecursiveASTVisitor<TreeDeleter> {
+    WithDecl *Decl = nullptr;
+public:
+    ~TreeDeleter() { delete Decl; }
+    void visitWithDecl(WithDecl &Node) { Decl = &Node; }
+    void visitFactor(Factor &Node) { delete &Node; }
+    void visitBinaryOp(BinaryOp &Node) { delete &Node; }
+};
+
+#endif
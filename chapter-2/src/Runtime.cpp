@@ -0,0 +1,90 @@
+#include "Runtime.hpp"
+
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/TargetParser/Host.h"
+#include "llvm/Transforms/IPO/Internalize.h"
+
+#include <memory>
+
+using namespace llvm;
+
+#ifdef CALC_HAVE_RUNTIME_BITCODE
+static const unsigned char RuntimeBitcode[] = {
+#include "rtcalc.bc.inc"
+};
+#endif
+
+Error calc::linkRuntime(Module &M) {
+#ifdef CALC_HAVE_RUNTIME_BITCODE
+    StringRef Bitcode(reinterpret_cast<const char *>(RuntimeBitcode),
+                      sizeof(RuntimeBitcode));
+    Expected<std::unique_ptr<Module>> Runtime = parseBitcodeFile(
+        MemoryBufferRef(Bitcode, "rtcalc.bc"), M.getContext());
+    if (!Runtime)
+        return Runtime.takeError();
+    (*Runtime) -> setTargetTriple(M.getTargetTriple());
+    (*Runtime) -> setDataLayout(M.getDataLayout());
+
+    // clang records the CPU it compiled for on every function. The
+    // generated functions have none, and the inliner refuses to
+    // inline a function needing features the caller doesn't have
+    for (Function &F : **Runtime) {
+        F.removeFnAttr("target-cpu");
+        F.removeFnAttr("target-features");
+        F.removeFnAttr("tune-cpu");
+    }
+
+    // Only the functions M calls are linked, and they are
+    // internalized, so they can be inlined and then removed
+    if (Linker::linkModules(M, std::move(*Runtime), Linker::LinkOnlyNeeded,
+                            [](Module &M, const StringSet<> &Linked) {
+                                internalizeModule(M, [&](const GlobalValue &GV) {
+                                    return !GV.hasName() ||
+                                           !Linked.count(GV.getName());
+                                });
+                            }))
+        return createStringError(inconvertibleErrorCode(),
+                                 "Linking the runtime failed");
+    return Error::success();
+#else
+    return createStringError(inconvertibleErrorCode(),
+                             "calc was built without the runtime bitcode");
+#endif
+}
+
+void calc::optimizeModule(Module &M) {
+    // The target machine tells the optimizer the costs of the
+    // instructions, e.g. for the inliner
+    InitializeNativeTarget();
+    std::string Triple = sys::getProcessTriple();
+    std::string Message;
+    std::unique_ptr<TargetMachine> TM;
+    if (const Target *T = TargetRegistry::lookupTarget(Triple, Message))
+        TM.reset(T -> createTargetMachine(Triple, "generic", "", TargetOptions(),
+                                          Reloc::PIC_));
+    if (TM) {
+        M.setTargetTriple(Triple);
+        M.setDataLayout(TM -> createDataLayout());
+    }
+
+    LoopAnalysisManager LAM;
+    FunctionAnalysisManager FAM;
+    CGSCCAnalysisManager CGAM;
+    ModuleAnalysisManager MAM;
+    PassBuilder PB(TM.get());
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+    ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(OptimizationLevel::O2);
+    MPM.run(M, MAM);
+}
@@ -0,0 +1,29 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+
+// The calc runtime, rtcalc.c, is embedded into the calc binary as
+// bitcode (compiled with clang at build time). Linking it into the
+// generated module turns the calls of calc_init(), calc_next(),
+// calc_read() and calc_write() into calls of internal functions,
+// which the optimizer inlines into `main()`. The resulting object
+// doesn't need rtcalc.c anymore, and supports --batch as well:
+//
+//   if (llvm::Error Err = linkRuntime(*M)) { ... }
+//   optimizeModule(*M);
+namespace calc {
+
+// Links the runtime functions used by M into it, with internal
+// linkage. Fails if calc was built without the bitcode (see the
+// CMake file)
+llvm::Error linkRuntime(llvm::Module &M);
+
+// Runs the -O2 pipeline on M. Sets the target triple and data layout
+// of M to the ones of the host
+void optimizeModule(llvm::Module &M);
+
+} // namespace calc
+
+#endif
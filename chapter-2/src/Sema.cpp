@@ -1,4 +1,5 @@
 #include "Sema.hpp"
+#include "RecursiveASTVisitor.h"
 #include "llvm/ADT/StringSet.h"
 
 // Note - Technically I shouldn't need to
@@ -6,7 +7,7 @@
 #include "llvm/Support/raw_ostream.h"
 
 namespace {
-class DeclCheck : public ASTVisitor {
+class DeclCheck : public RecursiveASTVisitor<DeclCheck> {
     llvm::StringSet<> Scope;
     bool HasError;
     enum ErrorType { Twice, Not };
@@ -20,7 +21,7 @@ public:
     DeclCheck() : HasError(false) {}
     bool hasError() { return HasError; }
 
-    virtual void visit(Factor &Node) override {
+    void visitFactor(Factor &Node) {
         if (Node.getKind() == Factor::Ident) {
             // If we are visiting a `Factor` node that
             // holds a variable name, we need to check that
@@ -30,31 +31,21 @@ public:
         }
     }
 
-    virtual void visit(BinaryOp &Node) override {
+    void visitBinaryOp(BinaryOp &Node) {
         // For a `BinaryOp` node, there is nothing to check
-        // other than that both sides exist and are visited
-        if (Node.getLeft())
-            // Visit the left node
-            Node.getLeft() -> accept(*this);
-        else
-            HasError = true;
-        
-        if (Node.getRight())
-            // Visit the right node
-            Node.getRight() -> accept(*this);
-        else
+        // other than that both sides exist. They have already
+        // been visited by the traversal
+        if (!Node.getLeft() || !Node.getRight())
             HasError = true;
     }
 
-    virtual void visit(WithDecl &Node) override {
+    void visitWithDecl(WithDecl &Node) {
         for (auto I = Node.begin(), E = Node.end(); I != E; ++I) {
             if (!Scope.insert(*I).second)
                 error(Twice, *I);
         }
-        if (Node.getExpr())
-            // Visit the expression
-            Node.getExpr() -> accept(*this);
-        else
+        // The expression is visited next by the traversal
+        if (!Node.getExpr())
             HasError = true;
     }
 };
@@ -64,7 +55,7 @@ bool Sema::semantic(AST *Tree) {
     if (!Tree)
         return false;
     DeclCheck Check;
-    Tree -> accept(Check);
+    Check.traverse(Tree);
     return Check.hasError();
 }
 
@@ -0,0 +1,141 @@
+#include "StencilCompiler.hpp"
+#include "RecursiveASTVisitor.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Memory.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace llvm;
+
+namespace {
+// A place in a stencil to patch. The next stencil is referenced
+// relative to the position of the hole, the operands are absolute
+struct Hole {
+    enum HoleKind { Next, Value, Offset, Depth };
+    uint32_t Pos;
+    HoleKind Kind;
+    bool PCRelative;
+    int32_t Addend;
+};
+
+struct Stencil {
+    const uint8_t *Code;
+    size_t Size;
+    const Hole *Holes;
+    size_t NumHoles;
+};
+
+enum StencilKind {
+#define STENCIL(Name) S_##Name,
+#include "Stencils.def"
+};
+
+#include "Stencils.inc"
+
+// Copies the stencils in postfix order. The code only refers to
+// itself relative to the position, so it is built in a buffer and
+// copied to executable memory as is
+class StencilEmitter : public RecursiveASTVisitor<StencilEmitter> {
+    SmallVector<uint8_t, 512> Code;
+    // Offsets of the variables in the values, in bytes
+    StringMap<uint32_t> VarOffsets;
+    // The number of operands on the stack, and its maximum
+    unsigned Depth = 0;
+    unsigned MaxDepth = 1;
+    // Patched once the maximum depth is known
+    SmallVector<std::pair<uint32_t, int32_t>, 1> DepthHoles;
+
+    void write32(uint32_t Pos, uint32_t V) {
+        std::memcpy(&Code[Pos], &V, sizeof(V));
+    }
+
+    void emit(StencilKind Kind, uint32_t Operand = 0) {
+        const Stencil &S = Stencils[Kind];
+        uint32_t Base = Code.size();
+        Code.append(S.Code, S.Code + S.Size);
+        uint32_t End = Code.size();
+        for (const Hole &H : ArrayRef<Hole>(S.Holes, S.NumHoles)) {
+            uint32_t Pos = Base + H.Pos;
+            switch (H.Kind) {
+            case Hole::Next:
+                write32(Pos, End + H.Addend - Pos);
+                break;
+            case Hole::Value:
+            case Hole::Offset:
+                write32(Pos, Operand + H.Addend);
+                break;
+            case Hole::Depth:
+                DepthHoles.push_back({Pos, H.Addend});
+                break;
+            }
+        }
+    }
+
+public:
+    StencilEmitter() { emit(S_Entry); }
+
+    void visitWithDecl(WithDecl &Node) {
+        uint32_t Offset = 0;
+        for (StringRef Var : Node) {
+            VarOffsets[Var] = Offset;
+            Offset += sizeof(int32_t);
+        }
+    }
+
+    void visitFactor(Factor &Node) {
+        if (Node.getKind() == Factor::Ident)
+            emit(S_Var, VarOffsets.lookup(Node.getVal()));
+        else
+            emit(S_Const, Node.getIntVal());
+        MaxDepth = std::max(MaxDepth, ++Depth);
+    }
+
+    void visitBinaryOp(BinaryOp &Node) {
+        switch (Node.getOperator()) {
+        case BinaryOp::Plus:
+            emit(S_Add);
+            break;
+        case BinaryOp::Minus:
+            emit(S_Sub);
+            break;
+        case BinaryOp::Mul:
+            emit(S_Mul);
+            break;
+        case BinaryOp::Div:
+            emit(S_Div);
+            break;
+        }
+        --Depth;
+    }
+
+    // Returns the code of the whole expression
+    ArrayRef<uint8_t> finish() {
+        emit(S_Ret);
+        for (auto &PosAndAddend : DepthHoles)
+            write32(PosAndAddend.first, MaxDepth + PosAndAddend.second);
+        return Code;
+    }
+};
+} // namespace
+
+Expected<StencilCompiler::FunctionTy> StencilCompiler::compile(AST *Tree) {
+    StencilEmitter Emitter;
+    Emitter.traverse(Tree);
+    ArrayRef<uint8_t> Code = Emitter.finish();
+
+    std::error_code EC;
+    sys::MemoryBlock Block = sys::Memory::allocateMappedMemory(
+        Code.size(), nullptr, sys::Memory::MF_READ | sys::Memory::MF_WRITE, EC);
+    if (EC)
+        return errorCodeToError(EC);
+    std::memcpy(Block.base(), Code.data(), Code.size());
+    EC = sys::Memory::protectMappedMemory(
+        Block, sys::Memory::MF_READ | sys::Memory::MF_EXEC);
+    if (EC)
+        return errorCodeToError(EC);
+    sys::Memory::InvalidateInstructionCache(Block.base(), Code.size());
+    return reinterpret_cast<FunctionTy>(Block.base());
+}
@@ -0,0 +1,38 @@
+#ifndef STENCIL_COMPILER_H
+#define STENCIL_COMPILER_H
+
+#include "AST.h"
+
+#include "llvm/Support/Error.h"
+
+#include <cstdint>
+
+// A baseline compiler, which generates native code for an expression
+// without LLVM's backend, by "copy-and-patch": the code for every kind
+// of node is a precompiled piece of machine code, a stencil, with
+// holes for its operands. Compiling copies the stencils for the nodes
+// in postfix order one after the other, and patches the holes with
+// the values of numbers and the offsets of variables. This takes
+// microseconds instead of the milliseconds of building a module and
+// running the backend, at the price of slower code: the operands go
+// through a stack in memory, and nothing is folded or optimized.
+//
+// The stencils are written in Stencils.ll and compiled at build time
+// by llc, and calc-stencilgen turns the object file into tables of
+// code and holes (Stencils.inc). Only x86-64 ELF is supported, see
+// the CMake file.
+//
+// The results are the same as those of the code from `CodeGen`,
+// as long as they are defined there: overflow and division by zero
+// are undefined in the IR, while the stencils wrap around on
+// overflow, and trap on division by zero.
+class StencilCompiler {
+public:
+    // The same signature as `CodeGen::generateFunction()`
+    using FunctionTy = int32_t (*)(const int32_t *Values);
+
+    // Compiles a checked tree. The code is never freed
+    static llvm::Expected<FunctionTy> compile(AST *Tree);
+};
+
+#endif
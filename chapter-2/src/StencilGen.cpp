@@ -0,0 +1,216 @@
+// calc-stencilgen runs at build time. It reads the object file llc
+// generates from Stencils.ll, and writes the machine code of every
+// stencil and its holes as C++ arrays, which StencilCompiler.cpp
+// includes:
+//
+//   calc-stencilgen Stencils.o -o Stencils.inc
+//
+// The object file must be x86-64 ELF, with every stencil in a section
+// of its own (llc -function-sections). Relocations of the kinds which
+// can't be patched by the baseline compiler, e.g. references to
+// constant pools, are reported as errors, as are missing stencils.
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/BinaryFormat/ELF.h"
+#include "llvm/Object/ELFObjectFile.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/WithColor.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<std::string> InputFile(cl::Positional, cl::Required,
+                                      cl::desc("<stencil object file>"));
+
+static cl::opt<std::string> OutputFile("o", cl::Required,
+                                       cl::desc("Write the stencils to <file>"),
+                                       cl::value_desc("file"));
+
+namespace {
+const char *const StencilNames[] = {
+#define STENCIL(Name) #Name,
+#include "Stencils.def"
+};
+
+struct Hole {
+    uint64_t Offset;
+    std::string Kind;   // Next, Value, Offset or Depth
+    bool PCRelative;
+    int64_t Addend;
+};
+
+struct Stencil {
+    StringRef Code;
+    std::vector<Hole> Holes;
+};
+
+// The tail call to the next stencil is the last instruction, a `jmp`
+// with a 32-bit displacement. The compiler copies the next stencil
+// right behind, so the jump is dropped
+void dropTailJump(Stencil &S) {
+    if (S.Holes.empty() || S.Code.size() < 5)
+        return;
+    const Hole &Last = S.Holes.back();
+    if (Last.Kind == "Next" && Last.PCRelative &&
+        Last.Offset == S.Code.size() - 4 &&
+        uint8_t(S.Code[S.Code.size() - 5]) == 0xe9) {
+        S.Code = S.Code.drop_back(5);
+        S.Holes.pop_back();
+    }
+}
+
+bool error(const Twine &Message) {
+    WithColor::error(errs(), "calc-stencilgen") << Message << "\n";
+    return false;
+}
+
+// Collects the holes of a stencil from the relocations of its section
+bool readHoles(const object::SectionRef &Relocations, StringRef Name,
+               Stencil &S) {
+    for (const object::RelocationRef &R : Relocations.relocations()) {
+        object::symbol_iterator Sym = R.getSymbol();
+        Expected<StringRef> SymName = Sym -> getName();
+        if (!SymName)
+            return error(toString(SymName.takeError()));
+        if (!SymName -> startswith("HOLE_"))
+            return error("stencil " + Name + " refers to " + *SymName +
+                         ", which isn't a hole");
+
+        Hole H;
+        H.Offset = R.getOffset();
+        H.Kind = SymName -> drop_front(5).lower();
+        H.Kind[0] = toupper(H.Kind[0]);
+        H.Addend = cantFail(object::ELFRelocationRef(R).getAddend());
+        switch (R.getType()) {
+        case ELF::R_X86_64_32:
+        case ELF::R_X86_64_32S:
+            H.PCRelative = false;
+            break;
+        case ELF::R_X86_64_PC32:
+        case ELF::R_X86_64_PLT32:
+            H.PCRelative = true;
+            break;
+        default:
+            return error("stencil " + Name + " has an unsupported relocation");
+        }
+        if (H.Kind != "Next" && H.Kind != "Value" && H.Kind != "Offset" &&
+            H.Kind != "Depth")
+            return error("unknown hole " + *SymName);
+        // Only the next stencil is at a known distance, the operands
+        // are immediates
+        if (H.PCRelative != (H.Kind == "Next"))
+            return error("stencil " + Name + " refers to " + *SymName +
+                         (H.PCRelative ? " relative to the code"
+                                       : " by its absolute address"));
+        S.Holes.push_back(H);
+    }
+    return true;
+}
+
+void writeStencils(raw_ostream &OS, ArrayRef<Stencil> Stencils) {
+    OS << "// Generated by calc-stencilgen from Stencils.ll, do not edit\n\n";
+    for (unsigned I = 0; I < Stencils.size(); ++I) {
+        const Stencil &S = Stencils[I];
+        OS << "static const uint8_t Code" << StencilNames[I] << "[] = {";
+        for (unsigned char C : S.Code)
+            OS << format("0x%02x,", C);
+        OS << "};\n";
+        OS << "static const Hole Holes" << StencilNames[I] << "[] = {";
+        for (const Hole &H : S.Holes)
+            OS << "{" << H.Offset << ", Hole::" << H.Kind << ", "
+               << (H.PCRelative ? "true" : "false") << ", " << H.Addend << "},";
+        // An empty array is not allowed
+        if (S.Holes.empty())
+            OS << "{0, Hole::Next, false, 0}";
+        OS << "};\n";
+    }
+    OS << "\nstatic const Stencil Stencils[] = {\n";
+    for (unsigned I = 0; I < Stencils.size(); ++I)
+        OS << "    {Code" << StencilNames[I] << ", sizeof(Code"
+           << StencilNames[I] << "), Holes" << StencilNames[I] << ", "
+           << Stencils[I].Holes.size() << "},\n";
+    OS << "};\n";
+}
+} // namespace
+
+int main(int argc, const char **argv) {
+    InitLLVM X(argc, argv);
+    cl::ParseCommandLineOptions(argc, argv,
+                                "calc-stencilgen - extracts the stencils of "
+                                "the baseline compiler\n");
+
+    Expected<object::OwningBinary<object::ObjectFile>> ObjOrErr =
+        object::ObjectFile::createObjectFile(InputFile);
+    if (!ObjOrErr) {
+        error(InputFile + ": " + toString(ObjOrErr.takeError()));
+        return 1;
+    }
+    const object::ObjectFile &Obj = *ObjOrErr -> getBinary();
+    if (!Obj.isELF() || Obj.getArch() != Triple::x86_64) {
+        error(InputFile + " is not an x86-64 ELF object file");
+        return 1;
+    }
+
+    // The code is in `.text.stencil_<Name>`, and the relocations are in
+    // a section of their own, pointing to the code section
+    StringMap<Stencil> ByName;
+    for (const object::SectionRef &Section : Obj.sections()) {
+        Expected<StringRef> SectionName = Section.getName();
+        if (!SectionName || !SectionName -> consume_front(".text.stencil_"))
+            continue;
+        Expected<StringRef> Contents = Section.getContents();
+        if (!Contents) {
+            error(toString(Contents.takeError()));
+            return 1;
+        }
+        ByName[*SectionName].Code = *Contents;
+    }
+    for (const object::SectionRef &Section : Obj.sections()) {
+        Expected<object::section_iterator> Target = Section.getRelocatedSection();
+        if (!Target) {
+            error(toString(Target.takeError()));
+            return 1;
+        }
+        if (*Target == Obj.section_end())
+            continue;
+        Expected<StringRef> TargetName = (*Target) -> getName();
+        if (!TargetName || !TargetName -> consume_front(".text.stencil_"))
+            continue;
+        if (!readHoles(Section, *TargetName, ByName[*TargetName]))
+            return 1;
+    }
+
+    std::vector<Stencil> Stencils;
+    for (const char *Name : StencilNames) {
+        auto It = ByName.find(Name);
+        if (It == ByName.end() || It -> second.Code.empty()) {
+            error(Twine("stencil ") + Name + " not found in " + InputFile);
+            return 1;
+        }
+        Stencil &S = It -> second;
+        llvm::sort(S.Holes, [](const Hole &A, const Hole &B) {
+            return A.Offset < B.Offset;
+        });
+        dropTailJump(S);
+        Stencils.push_back(S);
+    }
+
+    std::error_code EC;
+    ToolOutputFile Out(OutputFile, EC, sys::fs::OF_None);
+    if (EC) {
+        error("cannot open " + OutputFile + ": " + EC.message());
+        return 1;
+    }
+    writeStencils(Out.os(), Stencils);
+    Out.keep();
+    return 0;
+}
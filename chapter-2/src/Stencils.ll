@@ -0,0 +1,98 @@
+; The machine code templates ("stencils") of the baseline compiler,
+; see StencilCompiler.hpp. They are compiled with llc at build time,
+; and calc-stencilgen extracts their code and the places to patch
+; ("holes") from the object file.
+;
+; They are written in IR rather than in C, because the chain depends
+; on every stencil ending in a guaranteed tail call with the same
+; signature (musttail), which C can't express portably, and because
+; llc comes with every LLVM installation, while clang is optional
+; (it is only needed for calc --inline-runtime).
+;
+; The code is a chain of stencils for the postfix form of the
+; expression. Every stencil passes the values of the variables, the
+; top of the operand stack and the operand on top of it, which is
+; kept in a register, on to the next one with a tail call. When the
+; next stencil is copied right behind, the jump to it is dropped.
+;
+; The holes are the addresses of the external symbols HOLE_*, which
+; are replaced with the operands at runtime. dso_local and the static
+; relocation model make llc use them as immediates:
+;
+;   HOLE_NEXT    the stencil behind this one
+;   HOLE_VALUE   the value of a number
+;   HOLE_OFFSET  the offset of a variable in the values, in bytes
+;   HOLE_DEPTH   the size of the operand stack
+
+@HOLE_VALUE = external dso_local global i8
+@HOLE_OFFSET = external dso_local global i8
+@HOLE_DEPTH = external dso_local global i8
+declare dso_local i32 @HOLE_NEXT(ptr, ptr, i32)
+
+; The function called by CompiledExpr. It allocates the operand stack
+; and calls the chain, which returns to it in the end
+define i32 @stencil_Entry(ptr %values) {
+  %depth = ptrtoint ptr @HOLE_DEPTH to i64
+  %stack = alloca i32, i64 %depth
+  %r = call i32 @HOLE_NEXT(ptr %values, ptr %stack, i32 0)
+  ret i32 %r
+}
+
+; Operands push the previous top, which is garbage for the first one.
+; The stack has room for it
+define i32 @stencil_Const(ptr %values, ptr %sp, i32 %top) {
+  store i32 %top, ptr %sp
+  %next = getelementptr i32, ptr %sp, i64 1
+  %v = ptrtoint ptr @HOLE_VALUE to i32
+  %r = musttail call i32 @HOLE_NEXT(ptr %values, ptr %next, i32 %v)
+  ret i32 %r
+}
+
+define i32 @stencil_Var(ptr %values, ptr %sp, i32 %top) {
+  store i32 %top, ptr %sp
+  %next = getelementptr i32, ptr %sp, i64 1
+  %offset = ptrtoint ptr @HOLE_OFFSET to i64
+  %p = getelementptr i8, ptr %values, i64 %offset
+  %v = load i32, ptr %p
+  %r = musttail call i32 @HOLE_NEXT(ptr %values, ptr %next, i32 %v)
+  ret i32 %r
+}
+
+; The operators pop the left operand. Unlike the IR from `CodeGen`,
+; where overflow is undefined, they wrap around on overflow, and
+; division by zero traps
+define i32 @stencil_Add(ptr %values, ptr %sp, i32 %top) {
+  %next = getelementptr i32, ptr %sp, i64 -1
+  %l = load i32, ptr %next
+  %v = add i32 %l, %top
+  %r = musttail call i32 @HOLE_NEXT(ptr %values, ptr %next, i32 %v)
+  ret i32 %r
+}
+
+define i32 @stencil_Sub(ptr %values, ptr %sp, i32 %top) {
+  %next = getelementptr i32, ptr %sp, i64 -1
+  %l = load i32, ptr %next
+  %v = sub i32 %l, %top
+  %r = musttail call i32 @HOLE_NEXT(ptr %values, ptr %next, i32 %v)
+  ret i32 %r
+}
+
+define i32 @stencil_Mul(ptr %values, ptr %sp, i32 %top) {
+  %next = getelementptr i32, ptr %sp, i64 -1
+  %l = load i32, ptr %next
+  %v = mul i32 %l, %top
+  %r = musttail call i32 @HOLE_NEXT(ptr %values, ptr %next, i32 %v)
+  ret i32 %r
+}
+
+define i32 @stencil_Div(ptr %values, ptr %sp, i32 %top) {
+  %next = getelementptr i32, ptr %sp, i64 -1
+  %l = load i32, ptr %next
+  %v = sdiv i32 %l, %top
+  %r = musttail call i32 @HOLE_NEXT(ptr %values, ptr %next, i32 %v)
+  ret i32 %r
+}
+
+define i32 @stencil_Ret(ptr %values, ptr %sp, i32 %top) {
+  ret i32 %top
+}
@@ -0,0 +1,59 @@
+#include "ThreadedLexer.hpp"
+#include "AllocStats.hpp"
+
+namespace {
+// Waiting is done by spinning for a while, as the other side is
+// usually quick to catch up, and then by yielding the core, which
+// matters if both threads share one
+template <typename Pred> void waitUntil(Pred Ready) {
+    for (unsigned Spins = 0; !Ready(); ++Spins)
+        if (Spins >= 64)
+            std::this_thread::yield();
+}
+} // namespace
+
+ThreadedLexer::ThreadedLexer(Lexer &Lex)
+    : Lex(Lex), Ring(new Batch[NumBatches]) {
+    Worker = std::thread([this] { produce(); });
+}
+
+ThreadedLexer::~ThreadedLexer() {
+    Stopped.store(true, std::memory_order_relaxed);
+    Worker.join();
+}
+
+void ThreadedLexer::produce() {
+    allocstats::setPhase(allocstats::Lexer);
+    for (size_t N = 0;; ++N) {
+        // Backpressure: wait until the parser has released the
+        // batch which was in this slot before
+        waitUntil([&] {
+            return N - Released.load(std::memory_order_acquire) < NumBatches ||
+                   Stopped.load(std::memory_order_relaxed);
+        });
+        if (Stopped.load(std::memory_order_relaxed))
+            return;
+
+        Batch &B = Ring[N % NumBatches];
+        bool AtEnd = false;
+        for (B.Size = 0; B.Size < BatchSize && !AtEnd; ++B.Size) {
+            Lex.next(B.Tokens[B.Size]);
+            AtEnd = B.Tokens[B.Size].is(Token::eoi);
+        }
+        Published.store(N + 1, std::memory_order_release);
+        if (AtEnd)
+            return;
+    }
+}
+
+void ThreadedLexer::nextBatch() {
+    // The final batch ends with `eoi`, which `next()` never moves
+    // past, so there always is a next batch when we get here
+    if (Current)
+        Released.store(++Consumed, std::memory_order_release);
+    waitUntil([&] {
+        return Published.load(std::memory_order_acquire) > Consumed;
+    });
+    Current = &Ring[Consumed % NumBatches];
+    Index = 0;
+}
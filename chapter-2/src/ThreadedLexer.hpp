@@ -0,0 +1,83 @@
+#ifndef THREADED_LEXER_H
+#define THREADED_LEXER_H
+
+#include "Lexer.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+// Runs a `Lexer` on its own thread, so that lexing overlaps with
+// parsing on another core. The lexer thread fills batches of tokens
+// into a ring buffer, which the parser empties through `next()`.
+// The parser creates it when asked to:
+//
+//   Lexer Lex(Buffer);
+//   Parser Parser(Lex, /*Threaded=*/true);
+//
+// The ring has exactly one producer and one consumer, so it needs no
+// locks: each side only writes its own index, and publishes it with
+// a release store after the batch is complete. Handing over whole
+// batches keeps the traffic between the cores low. When the ring is
+// full, the lexer waits for the parser (backpressure), so at most
+// NumBatches * BatchSize tokens are buffered, whatever the input size.
+//
+// Tokens still point into the input buffer, which must outlive them,
+// as usual.
+class ThreadedLexer {
+public:
+    static constexpr unsigned BatchSize = 512;
+    static constexpr unsigned NumBatches = 16; // A power of two
+
+private:
+    struct Batch {
+        Token Tokens[BatchSize];
+        unsigned Size;
+    };
+
+    Lexer &Lex;
+    std::unique_ptr<Batch[]> Ring;
+
+    // Number of batches published by the lexer and released by the
+    // parser. Both only grow; the slot of batch N is N % NumBatches.
+    // They live on separate cache lines, as each is written by a
+    // different core
+    alignas(64) std::atomic<size_t> Published{0};
+    alignas(64) std::atomic<size_t> Released{0};
+    std::atomic<bool> Stopped{false};
+
+    // Used by the parser only
+    alignas(64) Batch *Current = nullptr;
+    unsigned Index = 0;
+    size_t Consumed = 0;
+
+    std::thread Worker;
+
+    void produce();
+
+public:
+    explicit ThreadedLexer(Lexer &Lex);
+
+    // Stops the lexer thread, even if not all tokens were read
+    ~ThreadedLexer();
+
+    ThreadedLexer(const ThreadedLexer &) = delete;
+    ThreadedLexer &operator=(const ThreadedLexer &) = delete;
+
+    // Returns the next token, like `Lexer::next()`. After the end
+    // of the input, `eoi` is returned forever
+    void next(Token &Tok) {
+        if (!Current || Index == Current -> Size)
+            nextBatch();
+        Tok = Current -> Tokens[Index];
+        // Never move past the final `eoi`
+        if (!Tok.is(Token::eoi))
+            ++Index;
+    }
+
+private:
+    void nextBatch();
+};
+
+#endif
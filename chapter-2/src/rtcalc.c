@@ -1,17 +1,203 @@
 // The runtime library consists of a single file, rtcalc.c
 // It has the implementation for the calc_read() and calc_write()
 // functions, written in C
+//
+// The generated main() evaluates the expression in a loop, once for
+// every row of input (see createMain() in CodeGen.cpp):
+//
+//   calc_init(argc, argv);
+//   while (calc_next()) {
+//       ... calc_read() for every variable, in `with` order ...
+//       calc_write(result);
+//   }
+//
+// Without arguments, the values are read from the terminal, and the
+// loop runs once. With --batch, every line of standard input is a
+// row with the values of the variables, separated by commas, spaces
+// or tabs (so CSV files without a header work), and the results are
+// written one per line:
+//
+//   $ printf "2,4\n3 5\n" | ./expr --batch
+//   14
+//   24
+//
+// Batch mode reads the input in large blocks and parses the numbers
+// itself, and collects the output in a buffer, instead of going
+// through printf() and sscanf() for every value.
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+static int batch = 0;
+
+// The input of batch mode. Rows are kept whole in the buffer: the
+// unread part of the current row is [pos, row_end), and row_end
+// points to its '\n' or to the end of the input. Lines are counted
+// for error messages
+static char *in_buf;
+static size_t in_size, in_cap;
+static const char *pos, *row_end;
+static unsigned long line = 0;
+static int in_row = 0, in_eof = 0;
+
+static char out_buf[1 << 16];
+static size_t out_len = 0;
+
+static void flush_output(void)
+{
+	fwrite(out_buf, 1, out_len, stdout);
+	out_len = 0;
+	fflush(stdout);
+}
+
+static void batch_error(const char *msg)
+{
+	flush_output();
+	fprintf(stderr, "line %lu: %s\n", line, msg);
+	exit(1);
+}
+
+// Reads more input behind the unread rest, which is moved to the
+// front of the buffer. The buffer grows if a row doesn't fit
+static void refill(void)
+{
+	size_t rest = in_size - (pos - in_buf);
+	memmove(in_buf, pos, rest);
+	in_size = rest;
+	if (in_size == in_cap) {
+		in_cap *= 2;
+		in_buf = realloc(in_buf, in_cap);
+		if (!in_buf) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	}
+	pos = in_buf;
+	size_t n = fread(in_buf + in_size, 1, in_cap - in_size, stdin);
+	in_size += n;
+	if (n == 0)
+		in_eof = 1;
+}
+
+void calc_init(int argc, char **argv)
+{
+	if (argc == 2 && strcmp(argv[1], "--batch") == 0) {
+		batch = 1;
+		in_cap = 1 << 20;
+		in_buf = malloc(in_cap);
+		if (!in_buf) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		pos = row_end = in_buf;
+		atexit(flush_output);
+	} else if (argc > 1) {
+		fprintf(stderr, "Usage: %s [--batch]\n", argv[0]);
+		exit(1);
+	}
+}
+
+static int is_separator(char c)
+{
+	return c == ',' || c == ' ' || c == '\t' || c == '\r';
+}
+
+// Returns whether there is another row. Empty lines are skipped
+int calc_next(void)
+{
+	if (!batch) {
+		static int done = 0;
+		int first = !done;
+		done = 1;
+		return first;
+	}
+
+	if (in_row) {
+		// Only separators may follow the values of the row
+		while (pos < row_end && is_separator(*pos))
+			++pos;
+		if (pos < row_end)
+			batch_error("too many values");
+		if (pos < in_buf + in_size)
+			++pos; // The '\n'
+		in_row = 0;
+	}
+	for (;;) {
+		// The row ends at the next '\n', which memchr() finds
+		// with vector instructions
+		const char *end = in_buf + in_size;
+		const char *nl = memchr(pos, '\n', end - pos);
+		if (!nl && !in_eof) {
+			refill();
+			continue;
+		}
+		row_end = nl ? nl : end;
+		if (pos == row_end && !nl)
+			return 0;
+		++line;
+		const char *p = pos;
+		while (p < row_end && is_separator(*p))
+			++p;
+		if (p < row_end) {
+			in_row = 1;
+			return 1;
+		}
+		if (!nl)
+			return 0;
+		pos = nl + 1;
+	}
+}
 
 void calc_write(int v)
 {
-	printf("The result is: %d\n", v);
+	if (!batch) {
+		printf("The result is: %d\n", v);
+		return;
+	}
+	if (out_len > sizeof(out_buf) - 16)
+		flush_output();
+	// The digits are written backwards into a small buffer
+	char digits[12];
+	char *d = digits + sizeof(digits);
+	unsigned u = v < 0 ? 0u - (unsigned)v : (unsigned)v;
+	do {
+		*--d = '0' + u % 10;
+		u /= 10;
+	} while (u);
+	if (v < 0)
+		*--d = '-';
+	size_t n = digits + sizeof(digits) - d;
+	memcpy(out_buf + out_len, d, n);
+	out_len += n;
+	out_buf[out_len++] = '\n';
+}
+
+// Parses the next value of the current row. Values which don't fit
+// into an int wrap around
+static int batch_read(void)
+{
+	while (pos < row_end && is_separator(*pos))
+		++pos;
+	if (pos == row_end)
+		batch_error("too few values");
+	int negative = *pos == '-';
+	if (*pos == '-' || *pos == '+')
+		++pos;
+	const char *start = pos;
+	unsigned v = 0;
+	while (pos < row_end && (unsigned)(*pos - '0') < 10)
+		v = v * 10 + (*pos++ - '0');
+	if (pos == start || (pos < row_end && !is_separator(*pos)))
+		batch_error("invalid value");
+	return negative ? (int)(0u - v) : (int)v;
 }
 
 int calc_read(char *s)
 {
+	if (batch)
+		return batch_read();
+
 	char buf[64];
 	int val;
 	printf("Enter a value for %s: ", s);
@@ -29,4 +215,4 @@ int calc_read(char *s)
 // so we must carefully check the input. If the input is not
 // a number, we exit the application. A more complex approach
 // would be to make the user aware of the problem and ask for
-// a number again.
\ No newline at end of file
+// a number again.
@@ -0,0 +1,417 @@
+#ifndef TINYLANG_AST_AST_H
+#define TINYLANG_AST_AST_H
+
+#include "tinylang/Basic/LLVM.h"
+#include "tinylang/Basic/TokenKinds.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/SMLoc.h"
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace tinylang {
+
+/// Owns all nodes of an AST. The nodes are bump-allocated from one
+/// arena and are never destroyed individually: they are all freed
+/// at once together with the context. Therefore nodes must be
+/// trivially destructible, and lists of children are arrays in the
+/// arena as well (see copy()).
+class ASTContext {
+  llvm::BumpPtrAllocator Allocator;
+
+public:
+  template <typename T, typename... Args>
+  T *create(Args &&... Arguments) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "AST nodes are never destroyed");
+    return new (Allocator.Allocate<T>())
+        T(std::forward<Args>(Arguments)...);
+  }
+
+  /// Copies a list, usually collected in a SmallVector on the
+  /// stack while parsing, into the arena.
+  template <typename T> llvm::ArrayRef<T> copy(llvm::ArrayRef<T> Elems) {
+    if (Elems.empty())
+      return {};
+    T *Mem = Allocator.Allocate<T>(Elems.size());
+    std::uninitialized_copy(Elems.begin(), Elems.end(), Mem);
+    return llvm::ArrayRef<T>(Mem, Elems.size());
+  }
+
+  /// The bytes used by the nodes.
+  size_t getBytesAllocated() const {
+    return Allocator.getBytesAllocated();
+  }
+
+  /// The bytes held by the arena, including unused space at the
+  /// end of its slabs.
+  size_t getTotalMemory() const { return Allocator.getTotalMemory(); }
+};
+
+/// The names in the AST refer to the source text, so the source
+/// buffer must outlive the AST.
+struct Ident {
+  SMLoc Loc;
+  StringRef Name;
+};
+
+/// A possibly qualified name: identifier ( "." identifier )*
+using Qualident = llvm::ArrayRef<Ident>;
+
+class Expr;
+class Stmt;
+
+using ExprList = llvm::ArrayRef<Expr *>;
+using StmtList = llvm::ArrayRef<Stmt *>;
+
+class OperatorInfo {
+  SMLoc Loc;
+  tok::TokenKind Kind;
+
+public:
+  OperatorInfo(SMLoc Loc, tok::TokenKind Kind)
+      : Loc(Loc), Kind(Kind) {}
+
+  SMLoc getLocation() const { return Loc; }
+  tok::TokenKind getKind() const { return Kind; }
+};
+
+class Decl {
+public:
+  enum DeclKind {
+    DK_Module,
+    DK_Const,
+    DK_Var,
+    DK_Param,
+    DK_Proc
+  };
+
+private:
+  const DeclKind Kind;
+
+protected:
+  SMLoc Loc;
+  StringRef Name;
+
+public:
+  Decl(DeclKind Kind, SMLoc Loc, StringRef Name)
+      : Kind(Kind), Loc(Loc), Name(Name) {}
+
+  DeclKind getKind() const { return Kind; }
+  SMLoc getLocation() const { return Loc; }
+  StringRef getName() const { return Name; }
+};
+
+using DeclList = llvm::ArrayRef<Decl *>;
+
+/// [ "FROM" identifier ] "IMPORT" identList ";"
+struct Import {
+  SMLoc Loc;
+  /// Empty if there is no FROM part.
+  StringRef From;
+  llvm::ArrayRef<Ident> Names;
+};
+
+class ModuleDeclaration : public Decl {
+  llvm::ArrayRef<Import> Imports;
+  DeclList Decls;
+  StmtList Stmts;
+
+public:
+  ModuleDeclaration(SMLoc Loc, StringRef Name,
+                    llvm::ArrayRef<Import> Imports, DeclList Decls,
+                    StmtList Stmts)
+      : Decl(DK_Module, Loc, Name), Imports(Imports), Decls(Decls),
+        Stmts(Stmts) {}
+
+  llvm::ArrayRef<Import> getImports() const { return Imports; }
+  DeclList getDecls() const { return Decls; }
+  StmtList getStmts() const { return Stmts; }
+
+  static bool classof(const Decl *D) {
+    return D->getKind() == DK_Module;
+  }
+};
+
+class ConstantDeclaration : public Decl {
+  Expr *E;
+
+public:
+  ConstantDeclaration(SMLoc Loc, StringRef Name, Expr *E)
+      : Decl(DK_Const, Loc, Name), E(E) {}
+
+  Expr *getExpr() const { return E; }
+
+  static bool classof(const Decl *D) {
+    return D->getKind() == DK_Const;
+  }
+};
+
+class VariableDeclaration : public Decl {
+  Qualident Type;
+
+public:
+  VariableDeclaration(SMLoc Loc, StringRef Name, Qualident Type)
+      : Decl(DK_Var, Loc, Name), Type(Type) {}
+
+  Qualident getType() const { return Type; }
+
+  static bool classof(const Decl *D) {
+    return D->getKind() == DK_Var;
+  }
+};
+
+class FormalParameterDeclaration : public Decl {
+  Qualident Type;
+  bool IsVar;
+
+public:
+  FormalParameterDeclaration(SMLoc Loc, StringRef Name,
+                             Qualident Type, bool IsVar)
+      : Decl(DK_Param, Loc, Name), Type(Type), IsVar(IsVar) {}
+
+  Qualident getType() const { return Type; }
+  bool isVar() const { return IsVar; }
+
+  static bool classof(const Decl *D) {
+    return D->getKind() == DK_Param;
+  }
+};
+
+using FormalParamList =
+    llvm::ArrayRef<FormalParameterDeclaration *>;
+
+class ProcedureDeclaration : public Decl {
+  FormalParamList Params;
+  /// Empty for a procedure without return type.
+  Qualident RetType;
+  DeclList Decls;
+  StmtList Stmts;
+
+public:
+  ProcedureDeclaration(SMLoc Loc, StringRef Name,
+                       FormalParamList Params, Qualident RetType,
+                       DeclList Decls, StmtList Stmts)
+      : Decl(DK_Proc, Loc, Name), Params(Params), RetType(RetType),
+        Decls(Decls), Stmts(Stmts) {}
+
+  FormalParamList getFormalParams() const { return Params; }
+  Qualident getRetType() const { return RetType; }
+  DeclList getDecls() const { return Decls; }
+  StmtList getStmts() const { return Stmts; }
+
+  static bool classof(const Decl *D) {
+    return D->getKind() == DK_Proc;
+  }
+};
+
+class Expr {
+public:
+  enum ExprKind {
+    EK_Infix,
+    EK_Prefix,
+    EK_Int,
+    EK_Designator,
+    EK_Func
+  };
+
+private:
+  const ExprKind Kind;
+
+public:
+  Expr(ExprKind Kind) : Kind(Kind) {}
+
+  ExprKind getKind() const { return Kind; }
+};
+
+class InfixExpression : public Expr {
+  Expr *Left;
+  Expr *Right;
+  const OperatorInfo Op;
+
+public:
+  InfixExpression(Expr *Left, Expr *Right, OperatorInfo Op)
+      : Expr(EK_Infix), Left(Left), Right(Right), Op(Op) {}
+
+  Expr *getLeft() const { return Left; }
+  Expr *getRight() const { return Right; }
+  const OperatorInfo &getOperatorInfo() const { return Op; }
+
+  static bool classof(const Expr *E) {
+    return E->getKind() == EK_Infix;
+  }
+};
+
+class PrefixExpression : public Expr {
+  Expr *E;
+  const OperatorInfo Op;
+
+public:
+  PrefixExpression(Expr *E, OperatorInfo Op)
+      : Expr(EK_Prefix), E(E), Op(Op) {}
+
+  Expr *getExpr() const { return E; }
+  const OperatorInfo &getOperatorInfo() const { return Op; }
+
+  static bool classof(const Expr *E) {
+    return E->getKind() == EK_Prefix;
+  }
+};
+
+class IntegerLiteral : public Expr {
+  SMLoc Loc;
+  uint64_t Value;
+
+public:
+  IntegerLiteral(SMLoc Loc, uint64_t Value)
+      : Expr(EK_Int), Loc(Loc), Value(Value) {}
+
+  SMLoc getLocation() const { return Loc; }
+  uint64_t getValue() const { return Value; }
+
+  static bool classof(const Expr *E) {
+    return E->getKind() == EK_Int;
+  }
+};
+
+class Designator : public Expr {
+  Qualident Name;
+
+public:
+  Designator(Qualident Name) : Expr(EK_Designator), Name(Name) {}
+
+  Qualident getName() const { return Name; }
+
+  static bool classof(const Expr *E) {
+    return E->getKind() == EK_Designator;
+  }
+};
+
+class FunctionCallExpr : public Expr {
+  Qualident Name;
+  ExprList Params;
+
+public:
+  FunctionCallExpr(Qualident Name, ExprList Params)
+      : Expr(EK_Func), Name(Name), Params(Params) {}
+
+  Qualident getName() const { return Name; }
+  ExprList getParams() const { return Params; }
+
+  static bool classof(const Expr *E) {
+    return E->getKind() == EK_Func;
+  }
+};
+
+class Stmt {
+public:
+  enum StmtKind {
+    SK_Assign,
+    SK_ProcCall,
+    SK_If,
+    SK_While,
+    SK_Return
+  };
+
+private:
+  const StmtKind Kind;
+
+protected:
+  SMLoc Loc;
+
+public:
+  Stmt(StmtKind Kind, SMLoc Loc) : Kind(Kind), Loc(Loc) {}
+
+  StmtKind getKind() const { return Kind; }
+  SMLoc getLocation() const { return Loc; }
+};
+
+class AssignmentStatement : public Stmt {
+  Qualident Var;
+  Expr *E;
+
+public:
+  AssignmentStatement(SMLoc Loc, Qualident Var, Expr *E)
+      : Stmt(SK_Assign, Loc), Var(Var), E(E) {}
+
+  Qualident getVar() const { return Var; }
+  Expr *getExpr() const { return E; }
+
+  static bool classof(const Stmt *S) {
+    return S->getKind() == SK_Assign;
+  }
+};
+
+class ProcedureCallStatement : public Stmt {
+  Qualident Name;
+  ExprList Params;
+
+public:
+  ProcedureCallStatement(SMLoc Loc, Qualident Name,
+                         ExprList Params)
+      : Stmt(SK_ProcCall, Loc), Name(Name), Params(Params) {}
+
+  Qualident getName() const { return Name; }
+  ExprList getParams() const { return Params; }
+
+  static bool classof(const Stmt *S) {
+    return S->getKind() == SK_ProcCall;
+  }
+};
+
+class IfStatement : public Stmt {
+  Expr *Cond;
+  StmtList IfStmts;
+  StmtList ElseStmts;
+
+public:
+  IfStatement(SMLoc Loc, Expr *Cond, StmtList IfStmts,
+              StmtList ElseStmts)
+      : Stmt(SK_If, Loc), Cond(Cond), IfStmts(IfStmts),
+        ElseStmts(ElseStmts) {}
+
+  Expr *getCond() const { return Cond; }
+  StmtList getIfStmts() const { return IfStmts; }
+  StmtList getElseStmts() const { return ElseStmts; }
+
+  static bool classof(const Stmt *S) {
+    return S->getKind() == SK_If;
+  }
+};
+
+class WhileStatement : public Stmt {
+  Expr *Cond;
+  StmtList Stmts;
+
+public:
+  WhileStatement(SMLoc Loc, Expr *Cond, StmtList Stmts)
+      : Stmt(SK_While, Loc), Cond(Cond), Stmts(Stmts) {}
+
+  Expr *getCond() const { return Cond; }
+  StmtList getWhileStmts() const { return Stmts; }
+
+  static bool classof(const Stmt *S) {
+    return S->getKind() == SK_While;
+  }
+};
+
+class ReturnStatement : public Stmt {
+  /// nullptr for a RETURN without value.
+  Expr *RetVal;
+
+public:
+  ReturnStatement(SMLoc Loc, Expr *RetVal)
+      : Stmt(SK_Return, Loc), RetVal(RetVal) {}
+
+  Expr *getRetVal() const { return RetVal; }
+
+  static bool classof(const Stmt *S) {
+    return S->getKind() == SK_Return;
+  }
+};
+
+} // namespace tinylang
+#endif
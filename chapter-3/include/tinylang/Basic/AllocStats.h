@@ -0,0 +1,53 @@
+#ifndef TINYLANG_BASIC_ALLOCSTATS_H
+#define TINYLANG_BASIC_ALLOCSTATS_H
+
+#include "tinylang/Basic/LLVM.h"
+
+namespace tinylang {
+
+/// Allocation accounting for `--alloc-stats`. When enabled, every
+/// call to malloc(), calloc(), realloc() and the aligned variants -
+/// and therefore every `new`, SmallVector and StringMap growth - is
+/// counted and attributed to the phase the allocating thread is in.
+/// Per phase, the number of allocations, the allocated bytes and the
+/// peak of the live heap bytes are recorded. Releasing blocks
+/// allocated before enable() isn't accounted.
+///
+/// The allocator entry points of the C library are replaced, which is
+/// only implemented for glibc. Every program linking the
+/// implementation gets the replacements, so it lives with the only
+/// tool using it, in tools/tinylang-lex/AllocStats.cpp, not in the
+/// libraries. Marking phases only needs the inline parts of this
+/// header. While disabled, the replacements cost one flag check.
+namespace allocstats {
+
+enum Phase { Driver, Lexer, Parser, Sema, CodeGen, NumPhases };
+
+/// The phase the allocations of the current thread are attributed
+/// to. Defined inline, so marking phases doesn't pull in the rest.
+inline thread_local Phase CurrentPhase = Driver;
+
+/// Returns false if allocations can't be intercepted on this
+/// platform.
+bool isSupported();
+
+void enable();
+void disable();
+
+/// Prints a table of the statistics, disabling the accounting first.
+void print(raw_ostream &OS);
+
+/// Attributes the allocations of the current thread to a phase while
+/// the scope is active.
+class Scope {
+  Phase Saved;
+
+public:
+  explicit Scope(Phase P) : Saved(CurrentPhase) { CurrentPhase = P; }
+  ~Scope() { CurrentPhase = Saved; }
+};
+
+} // namespace allocstats
+} // namespace tinylang
+
+#endif
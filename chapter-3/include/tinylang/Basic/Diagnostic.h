@@ -2,29 +2,145 @@
 #define TINYLANG_BASIC_DIAGNOSTIC_H
 
 #include "tinylang/Basic/LLVM.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringRef.h"
-#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/SMLoc.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/raw_ostream.h"
-#include <utility>
+#include <cstdint>
+#include <string>
+#include <type_traits>
 
 namespace tinylang {
 
 namespace diag {
-enum {
+namespace detail {
+enum Kind : unsigned {
 #define DIAG(ID, Level, Msg) ID,
 #include "tinylang/Basic/Diagnostic.def"
+  NUM_DIAGNOSTICS
 };
+
+/// Not constexpr, so that calling it while evaluating a constant
+/// expression makes the compilation fail.
+inline void invalidFormat() {
+  llvm_unreachable("Invalid diagnostic format");
+}
+} // namespace detail
+
+/// A message of Diagnostic.def, split at its placeholders {N} into
+/// text pieces, each followed by an argument or none. The split is
+/// done once at compile time, so reporting only concatenates.
+struct Template {
+  static constexpr unsigned MaxPieces = 4;
+  struct Piece {
+    const char *Text = nullptr;
+    unsigned Length = 0;
+    /// The argument after the text, or -1.
+    int Arg = -1;
+  };
+  Piece Pieces[MaxPieces] = {};
+  unsigned NumPieces = 0;
+  unsigned NumArgs = 0;
+};
+
+/// Splits a message. Besides {N}, only the escape {{ is supported.
+constexpr Template parseTemplate(const char *Msg) {
+  Template T;
+  Template::Piece Cur{Msg, 0, -1};
+  auto Push = [&T](Template::Piece P) {
+    if (T.NumPieces == Template::MaxPieces)
+      detail::invalidFormat();
+    T.Pieces[T.NumPieces++] = P;
+  };
+  const char *P = Msg;
+  while (*P) {
+    if (*P != '{') {
+      ++Cur.Length;
+      ++P;
+      continue;
+    }
+    if (P[1] == '{') {
+      ++Cur.Length;
+      Push(Cur);
+      P += 2;
+      Cur = {P, 0, -1};
+      continue;
+    }
+    ++P;
+    if (*P < '0' || *P > '9')
+      detail::invalidFormat();
+    unsigned N = 0;
+    for (; *P >= '0' && *P <= '9'; ++P)
+      N = N * 10 + (*P - '0');
+    if (*P != '}')
+      detail::invalidFormat();
+    ++P;
+    Cur.Arg = N;
+    Push(Cur);
+    if (N + 1 > T.NumArgs)
+      T.NumArgs = N + 1;
+    Cur = {P, 0, -1};
+  }
+  if (Cur.Length)
+    Push(Cur);
+  return T;
+}
+
+/// The number of arguments of every diagnostic.
+constexpr unsigned NumArgs[] = {
+#define DIAG(ID, Level, Msg) parseTemplate(Msg).NumArgs,
+#include "tinylang/Basic/Diagnostic.def"
+};
+
+/// A diagnostic ID as a type of its own, so that report() checks
+/// the number of arguments at compile time. Converts to the plain
+/// ID, which is checked at runtime instead.
+template <unsigned ID> struct DiagID {
+  constexpr operator unsigned() const { return ID; }
+};
+
+#define DIAG(ID, Level, Msg) constexpr DiagID<detail::ID> ID{};
+#include "tinylang/Basic/Diagnostic.def"
 } // namespace diag
 
+/// An argument of a diagnostic: a string, which must live until the
+/// diagnostic is reported, or an integer.
+class DiagArg {
+  StringRef Str;
+  int64_t Int = 0;
+  bool IsInt = false;
+
+public:
+  DiagArg(StringRef Str) : Str(Str) {}
+  DiagArg(const char *Str) : Str(Str) {}
+  DiagArg(const std::string &Str) : Str(Str) {}
+  template <typename T, typename = std::enable_if_t<
+                            std::is_integral<T>::value>>
+  DiagArg(T Int) : Int(Int), IsInt(true) {}
+
+  void appendTo(llvm::SmallVectorImpl<char> &Buffer) const {
+    if (IsInt)
+      llvm::raw_svector_ostream(Buffer) << Int;
+    else
+      Buffer.append(Str.begin(), Str.end());
+  }
+};
+
 class DiagnosticsEngine {
-  static const char *getDiagnosticText(unsigned DiagID);
+  static const diag::Template &getTemplate(unsigned DiagID);
   static SourceMgr::DiagKind
   getDiagnosticKind(unsigned DiagID);
 
   SourceMgr &SrcMgr;
   unsigned NumErrors;
+  /// The message being reported, reused by every report.
+  llvm::SmallString<128> Buffer;
+
+  /// Renders the message of DiagID into Buffer.
+  StringRef format(unsigned DiagID, llvm::ArrayRef<DiagArg> Args);
 
 public:
   DiagnosticsEngine(SourceMgr &SrcMgr)
@@ -32,19 +148,43 @@ public:
 
   unsigned numErrors() { return NumErrors; }
 
-  template <typename... Args>
+  template <unsigned ID, typename... Args>
+  void report(SMLoc Loc, diag::DiagID<ID>, Args &&... Arguments) {
+    static_assert(sizeof...(Args) == diag::NumArgs[ID],
+                  "Wrong number of diagnostic arguments");
+    report(Loc, ID, {DiagArg(std::forward<Args>(Arguments))...});
+  }
+
+  /// Reports a diagnostic whose ID is only known at runtime.
   void report(SMLoc Loc, unsigned DiagID,
+              llvm::ArrayRef<DiagArg> Args = {});
+
+  /// Reports a diagnostic in text which isn't held by SrcMgr,
+  /// e.g. a streamed input, at the given line and (0-based)
+  /// column of file FileName.
+  template <unsigned ID, typename... Args>
+  void report(StringRef FileName, unsigned Line, unsigned Column,
+              StringRef LineText, diag::DiagID<ID>,
               Args &&... Arguments) {
-    std::string Msg =
-        llvm::formatv(getDiagnosticText(DiagID),
-                      std::forward<Args>(Arguments)...)
-            .str();
-    SourceMgr::DiagKind Kind = getDiagnosticKind(DiagID);
-    SrcMgr.PrintMessage(Loc, Kind, Msg);
-    NumErrors += (Kind == SourceMgr::DK_Error);
+    static_assert(sizeof...(Args) == diag::NumArgs[ID],
+                  "Wrong number of diagnostic arguments");
+    report(FileName, Line, Column, LineText, ID,
+           {DiagArg(std::forward<Args>(Arguments))...});
+  }
+
+  void report(StringRef FileName, unsigned Line, unsigned Column,
+              StringRef LineText, unsigned DiagID,
+              llvm::ArrayRef<DiagArg> Args = {});
+
+  /// Reports a diagnostic which was produced with another
+  /// SourceMgr, e.g. while lexing an imported module on a
+  /// worker thread.
+  void report(const llvm::SMDiagnostic &Diag) {
+    SrcMgr.PrintMessage(llvm::errs(), Diag);
+    NumErrors += (Diag.getKind() == SourceMgr::DK_Error);
   }
 };
 
 } // namespace tinylang
 
-#endif
\ No newline at end of file
+#endif
@@ -1,7 +1,7 @@
 #ifndef TINYLANG_BASIC_VERSION_H
 #define TINYLANG_BASIC_VERSION_H
 
-#include "tinylang/Basic/Version.inc.in"
+#include "tinylang/Basic/Version.inc"
 #include <string>
 
 namespace tinylang {
@@ -3,6 +3,7 @@
 
 #include "tinylang/Basic/Diagnostic.h"
 #include "tinylang/Basic/LLVM.h"
+#include "tinylang/Lexer/StreamBuffer.h"
 #include "tinylang/Lexer/Token.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
@@ -20,9 +21,14 @@ class KeywordFilter {
 public:
   void addKeywords();
 
+  /// Returns the table of all keywords. It is built once on
+  /// first use and never modified afterwards, so it is shared by
+  /// all lexers, including lexers running on different threads.
+  static const KeywordFilter &getKeywords();
+
   tok::TokenKind getKeyword(
       StringRef Name,
-      tok::TokenKind DefaultTokenCode = tok::unknown) {
+      tok::TokenKind DefaultTokenCode = tok::unknown) const {
     auto Result = HashTable.find(Name);
     if (Result != HashTable.end())
       return Result->second;
@@ -41,15 +47,36 @@ class Lexer {
   /// lexing from as managed by the SourceMgr object.
   unsigned CurBuffer = 0;
 
-  KeywordFilter Keywords;
+  const KeywordFilter &Keywords;
+
+  /// The input in streaming mode, else nullptr.
+  StreamBuffer *Stream = nullptr;
 
 public:
   Lexer(SourceMgr &SrcMgr, DiagnosticsEngine &Diags)
-      : SrcMgr(SrcMgr), Diags(Diags) {
-    CurBuffer = SrcMgr.getMainFileID();
+      : Lexer(SrcMgr, Diags, SrcMgr.getMainFileID()) {}
+
+  /// Lexes the buffer BufferID of SrcMgr, e.g. the source of an
+  /// imported module.
+  Lexer(SourceMgr &SrcMgr, DiagnosticsEngine &Diags,
+        unsigned BufferID)
+      : SrcMgr(SrcMgr), Diags(Diags), CurBuffer(BufferID),
+        Keywords(KeywordFilter::getKeywords()) {
     CurBuf = SrcMgr.getMemoryBuffer(CurBuffer)->getBuffer();
     CurPtr = CurBuf.begin();
-    Keywords.addKeywords();
+  }
+
+  /// Lexes a stream, which is read in chunks as the lexer proceeds.
+  /// The text of a token, and its location, only stay valid until
+  /// the next call to next(). Diagnostics are reported with the
+  /// line and column in the stream, as the text isn't held by
+  /// SrcMgr.
+  Lexer(SourceMgr &SrcMgr, DiagnosticsEngine &Diags,
+        StreamBuffer &Stream)
+      : SrcMgr(SrcMgr), Diags(Diags),
+        Keywords(KeywordFilter::getKeywords()), Stream(&Stream) {
+    CurBuf = StringRef(Stream.begin(), Stream.end() - Stream.begin());
+    CurPtr = CurBuf.begin();
   }
 
   DiagnosticsEngine &getDiagnostics() const {
@@ -70,6 +97,14 @@ private:
 
   SMLoc getLoc() { return SMLoc::getFromPointer(CurPtr); }
 
+  void report(const char *Ptr, unsigned DiagID);
+
+  /// In streaming mode, reads more input if Ptr is less than
+  /// Lookahead bytes before the end of the window. The current
+  /// token, from CurPtr on, is kept; CurPtr and Ptr are moved
+  /// along with it. Returns false if there is no more input.
+  bool fill(const char *&Ptr, unsigned Lookahead = 0);
+
   void formToken(Token &Result, const char *TokEnd,
                  tok::TokenKind Kind);
 };
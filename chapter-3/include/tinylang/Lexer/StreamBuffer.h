@@ -0,0 +1,85 @@
+#ifndef TINYLANG_LEXER_STREAMBUFFER_H
+#define TINYLANG_LEXER_STREAMBUFFER_H
+
+#include "tinylang/Basic/LLVM.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tinylang {
+
+/// A window into a file which is read in fixed-size chunks, for
+/// lexing inputs which come from a pipe or don't fit into memory.
+///
+/// Like a MemoryBuffer, the window is terminated by a null
+/// character, so the lexer finds its end with the checks it does
+/// anyway. When the lexer reaches the end, refill() discards the
+/// consumed part of the window and appends the next chunk. The part
+/// of a token read so far is kept, so tokens can span chunks. The
+/// window only grows beyond the chunk size for tokens longer than a
+/// chunk, so the memory use doesn't depend on the size of the input.
+class StreamBuffer {
+  llvm::sys::fs::file_t File;
+  bool OwnsFile;
+  std::string Name;
+  size_t ChunkSize;
+  /// The window. The byte after the valid data is always 0.
+  std::vector<char> Data;
+  size_t Size = 0;
+  bool AtEOF = false;
+  std::error_code ReadError;
+
+  /// Bytes and lines discarded so far, and the number of bytes of
+  /// the current line that were discarded.
+  uint64_t DiscardedBytes = 0;
+  unsigned DiscardedLines = 0;
+  unsigned DiscardedColumns = 0;
+
+  StreamBuffer(llvm::sys::fs::file_t File, bool OwnsFile,
+               StringRef Name, size_t ChunkSize);
+
+public:
+  /// Where a pointer into the window is in the whole input.
+  struct Location {
+    unsigned Line;
+    /// 0-based, as in SMDiagnostic.
+    unsigned Column;
+    /// The line, or nothing if its start isn't in the window
+    /// anymore.
+    std::string LineText;
+  };
+
+  /// Opens FileName for reading, or stdin if FileName is "-".
+  static llvm::Expected<std::unique_ptr<StreamBuffer>>
+  open(StringRef FileName, size_t ChunkSize = 64 * 1024);
+
+  ~StreamBuffer();
+
+  StringRef getName() const { return Name; }
+  const char *begin() const { return Data.data(); }
+  const char *end() const { return Data.data() + Size; }
+
+  /// True once the whole input has been read.
+  bool atEOF() const { return AtEOF; }
+
+  /// The error which ended reading, if any.
+  std::error_code getError() const { return ReadError; }
+
+  /// Bytes read so far.
+  uint64_t getBytesRead() const { return DiscardedBytes + Size; }
+
+  /// Discards the window up to Keep, which must point into the
+  /// window or to its end, and reads the next chunk. A short
+  /// beginning of Keep's line is kept as well, for the source line
+  /// printed with diagnostics. The kept data moves to begin(), and
+  /// Keep is updated. Returns the number of bytes read, which is 0
+  /// at the end of the input.
+  size_t refill(const char *&Keep);
+
+  Location getLocation(const char *Ptr) const;
+};
+} // namespace tinylang
+#endif
@@ -5,6 +5,8 @@
 #include "tinylang/Basic/TokenKinds.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/SMLoc.h"
+#include <cassert>
+#include <cstdint>
 
 namespace tinylang {
 
@@ -22,6 +24,9 @@ class Token {
   /// Kind - The actual flavor of token this is.
   tok::TokenKind Kind;
 
+  /// The value of an integer literal, converted by the lexer.
+  uint64_t IntValue = 0;
+
 public:
   tok::TokenKind getKind() const { return Kind; }
   void setKind(tok::TokenKind K) { Kind = K; }
@@ -51,13 +56,19 @@ public:
   }
   size_t getLength() const { return Length; }
 
-  StringRef getIdentifier() {
+  StringRef getIdentifier() const {
     assert(is(tok::identifier) &&
            "Cannot get identfier of non-identifier");
     return StringRef(Ptr, Length);
   }
 
-  StringRef getLiteralData() {
+  uint64_t getIntegerValue() const {
+    assert(is(tok::integer_literal) &&
+           "Cannot get value of non-integer literal");
+    return IntValue;
+  }
+
+  StringRef getLiteralData() const {
     assert(isOneOf(tok::integer_literal,
                    tok::string_literal) &&
            "Cannot get literal data of non-literal");
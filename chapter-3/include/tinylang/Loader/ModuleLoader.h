@@ -0,0 +1,122 @@
+#ifndef TINYLANG_LOADER_MODULELOADER_H
+#define TINYLANG_LOADER_MODULELOADER_H
+
+#include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Basic/LLVM.h"
+#include "tinylang/Lexer/Lexer.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/ThreadPool.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tinylang {
+
+/// The part of a module its importers depend on: the modules it
+/// imports itself and the declarations at module level. It is
+/// extracted from the tokens of the module, without parsing it.
+struct ModuleInterface {
+  struct Import {
+    std::string Module;
+    /// Offset of the module name in the importing source.
+    size_t Offset;
+  };
+
+  enum DeclKind { Const, Var, Procedure };
+
+  struct Decl {
+    DeclKind Kind;
+    std::string Name;
+  };
+
+  /// The name after MODULE.
+  std::string Name;
+  std::vector<Import> Imports;
+  std::vector<Decl> Decls;
+
+  /// Scans all tokens of the lexer's buffer.
+  static ModuleInterface scan(Lexer &Lex);
+
+  /// Writes the interface in the format of the interface cache.
+  void write(raw_ostream &OS) const;
+
+  /// Reads an interface written by write(). Returns false if Text
+  /// is not a valid interface.
+  static bool read(StringRef Text, ModuleInterface &Result);
+};
+
+/// Resolves the imports of a module. Imported modules are searched
+/// as <Name>.mod in the search paths and added to the SourceMgr, with
+/// the (first) import as include location, so diagnostics inside
+/// them show where they were imported from.
+///
+/// The dependency graph is loaded breadth first. All modules
+/// discovered in one round are read (memory mapped, when large
+/// enough) and scanned in parallel on a thread pool. Each module is
+/// loaded and lexed at most once, no matter how often it is imported.
+///
+/// With a cache directory, the interfaces are stored there, keyed
+/// by a hash of the module source. An unchanged module then costs a
+/// read and a hash, but isn't lexed again, so reloading a large
+/// graph mostly costs the time to lex what changed.
+class ModuleLoader {
+public:
+  struct Module {
+    std::string Name;
+    /// Empty for the module passed to loadImports().
+    std::string Path;
+    unsigned BufferID = 0;
+    uint64_t Hash = 0;
+    /// True if the interface came from the cache.
+    bool Cached = false;
+    ModuleInterface Interface;
+  };
+
+private:
+  SourceMgr &SrcMgr;
+  DiagnosticsEngine &Diags;
+  std::vector<std::string> SearchPaths;
+  std::string CacheDir;
+  llvm::ThreadPool Pool;
+
+  /// All modules, by name. The modules are allocated separately,
+  /// so pointers to them stay valid.
+  StringMap<std::unique_ptr<Module>> Modules;
+  std::vector<Module *> LoadOrder;
+
+  struct Job;
+  void run(Job &J);
+  bool readCached(Job &J);
+  void writeCached(const Job &J);
+
+public:
+  /// Scans the modules on NumThreads threads, or on one thread per
+  /// core if NumThreads is 0.
+  ModuleLoader(SourceMgr &SrcMgr, DiagnosticsEngine &Diags,
+               unsigned NumThreads = 0);
+
+  void addSearchPath(StringRef Dir) {
+    SearchPaths.push_back(Dir.str());
+  }
+
+  /// Caches interfaces in Dir, which is created if necessary. No
+  /// cache is used if Dir is empty.
+  void setCacheDir(StringRef Dir) { CacheDir = Dir.str(); }
+
+  /// Loads the module in buffer BufferID and, transitively, all
+  /// modules it imports. Returns false if errors were reported.
+  bool loadImports(unsigned BufferID);
+
+  /// Returns the loaded module Name, or nullptr.
+  const Module *getModule(StringRef Name) const {
+    auto It = Modules.find(Name);
+    return It == Modules.end() ? nullptr : It->second.get();
+  }
+
+  /// All loaded modules, in the order they were discovered.
+  llvm::ArrayRef<Module *> modules() const { return LoadOrder; }
+};
+} // namespace tinylang
+#endif
@@ -0,0 +1,163 @@
+#ifndef TINYLANG_PARSER_PARSER_H
+#define TINYLANG_PARSER_PARSER_H
+
+#include "tinylang/AST/AST.h"
+#include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Basic/TokenKinds.h"
+#include "tinylang/Lexer/Lexer.h"
+#include "llvm/ADT/SmallVector.h"
+#include <cstdint>
+#include <initializer_list>
+
+namespace tinylang {
+
+/// A set of token kinds as a bitmask, so that testing whether a
+/// token is in a set - e.g. the follow set of a grammar rule - is
+/// a shift and an and.
+class TokenSet {
+  static_assert(tok::NUM_TOKENS <= 64,
+                "Token kinds don't fit into the mask");
+  uint64_t Bits = 0;
+
+  constexpr explicit TokenSet(uint64_t Bits) : Bits(Bits) {}
+
+public:
+  constexpr TokenSet() = default;
+  constexpr TokenSet(std::initializer_list<tok::TokenKind> Kinds) {
+    for (tok::TokenKind Kind : Kinds)
+      Bits |= uint64_t(1) << Kind;
+  }
+
+  constexpr bool contains(tok::TokenKind Kind) const {
+    return (Bits >> Kind) & 1;
+  }
+
+  constexpr TokenSet operator|(TokenSet Other) const {
+    return TokenSet(Bits | Other.Bits);
+  }
+};
+
+/// A recursive-descent parser for tinylang. The AST is allocated in
+/// the arena of an ASTContext, and tokens are read through a small
+/// ring buffer, so that parsing allocates no memory per node or
+/// token. The ring allows to peek a few tokens ahead, which is used
+/// to recover from a single stray token.
+///
+/// After a syntax error, the parser skips to a token in the
+/// precomputed follow set of the current grammar rule, and
+/// continues from there. The nodes which were not parsed
+/// completely are left out of the AST.
+///
+/// The names in the AST refer to the source text, so the lexer must
+/// lex a buffer of a SourceMgr, not a stream.
+class Parser {
+  Lexer &Lex;
+  DiagnosticsEngine &Diags;
+  ASTContext &Ctx;
+
+  /// The current token and up to LookaheadSize - 1 tokens after
+  /// it. NumLexed tokens starting at Head have been read already.
+  static constexpr unsigned LookaheadSize = 4;
+  static_assert((LookaheadSize & (LookaheadSize - 1)) == 0,
+                "LookaheadSize must be a power of 2");
+  Token Ring[LookaheadSize];
+  unsigned Head = 0;
+  unsigned NumLexed = 0;
+  uint64_t NumTokens = 0;
+  bool ReportedEOF = false;
+
+  const Token &tok() const { return Ring[Head]; }
+
+  void lex(Token &Tok) {
+    Lex.next(Tok);
+    ++NumTokens;
+  }
+
+  /// Returns the N-th token after the current one.
+  const Token &peek(unsigned N) {
+    assert(N < LookaheadSize && "Peeking too far ahead");
+    for (; NumLexed <= N; ++NumLexed)
+      lex(Ring[(Head + NumLexed) & (LookaheadSize - 1)]);
+    return Ring[(Head + N) & (LookaheadSize - 1)];
+  }
+
+  void advance() {
+    Head = (Head + 1) & (LookaheadSize - 1);
+    if (--NumLexed == 0) {
+      lex(Ring[Head]);
+      NumLexed = 1;
+    }
+  }
+
+  /// Reports that Expected, e.g. "expression", was expected at
+  /// the current token.
+  void error(const char *Expected);
+  void error(tok::TokenKind Expected);
+
+  /// Returns true and reports an error if the current token is not
+  /// of kind Kind. A single unexpected token in front of the
+  /// expected one is skipped instead.
+  bool expect(tok::TokenKind Kind);
+
+  bool consume(tok::TokenKind Kind) {
+    if (expect(Kind))
+      return true;
+    advance();
+    return false;
+  }
+
+  /// Skips tokens up to the next token in Follow, or to the end of
+  /// the input. Returns false, as the parser can continue from
+  /// there.
+  bool skipUntil(TokenSet Follow);
+
+  template <typename T>
+  llvm::ArrayRef<T> copy(const llvm::SmallVectorImpl<T> &Elems) {
+    return Ctx.copy(llvm::ArrayRef<T>(Elems));
+  }
+
+  bool parseCompilationUnit(ModuleDeclaration *&D);
+  bool parseImport(llvm::SmallVectorImpl<Import> &Imports);
+  bool parseBlock(DeclList &Decls, StmtList &Stmts);
+  bool parseDeclaration(llvm::SmallVectorImpl<Decl *> &Decls);
+  bool parseConstantDeclaration(llvm::SmallVectorImpl<Decl *> &Decls);
+  bool parseVariableDeclaration(llvm::SmallVectorImpl<Decl *> &Decls);
+  bool parseProcedureDeclaration(llvm::SmallVectorImpl<Decl *> &Decls);
+  bool parseFormalParameters(FormalParamList &Params,
+                             Qualident &RetType);
+  bool parseFormalParameterList(
+      llvm::SmallVectorImpl<FormalParameterDeclaration *> &Params);
+  bool parseFormalParameter(
+      llvm::SmallVectorImpl<FormalParameterDeclaration *> &Params);
+  bool parseStatementSequence(StmtList &Stmts);
+  bool parseStatement(llvm::SmallVectorImpl<Stmt *> &Stmts);
+  bool parseIfStatement(llvm::SmallVectorImpl<Stmt *> &Stmts);
+  bool parseWhileStatement(llvm::SmallVectorImpl<Stmt *> &Stmts);
+  bool parseReturnStatement(llvm::SmallVectorImpl<Stmt *> &Stmts);
+  bool parseExpList(llvm::SmallVectorImpl<Expr *> &Exprs);
+  bool parseExpression(Expr *&E);
+  bool parseSimpleExpression(Expr *&E);
+  bool parseTerm(Expr *&E);
+  bool parseFactor(Expr *&E);
+  bool parseQualident(Qualident &Name);
+  bool parseIdentList(llvm::SmallVectorImpl<Ident> &Ids);
+
+public:
+  Parser(Lexer &Lex, ASTContext &Ctx)
+      : Lex(Lex), Diags(Lex.getDiagnostics()), Ctx(Ctx) {
+    lex(Ring[Head]);
+    NumLexed = 1;
+  }
+
+  DiagnosticsEngine &getDiagnostics() const { return Diags; }
+
+  /// Parses a compilation unit. Returns nullptr if the module
+  /// header can't be parsed; other syntax errors are reported, and
+  /// the AST is built from the rest of the input.
+  ModuleDeclaration *parse();
+
+  /// The number of tokens read from the lexer.
+  uint64_t getNumTokens() const { return NumTokens; }
+};
+} // namespace tinylang
+#endif
@@ -3,8 +3,8 @@
 using namespace tinylang;
 
 namespace {
-const char *DiagnosticText[] = {
-#define DIAG(ID, Level, Msg) Msg,
+constexpr diag::Template Templates[] = {
+#define DIAG(ID, Level, Msg) diag::parseTemplate(Msg),
 #include "tinylang/Basic/Diagnostic.def"
 };
 SourceMgr::DiagKind DiagnosticKind[] = {
@@ -13,12 +13,43 @@ SourceMgr::DiagKind DiagnosticKind[] = {
 };
 } // namespace
 
-const char *
-DiagnosticsEngine::getDiagnosticText(unsigned DiagID) {
-  return DiagnosticText[DiagID];
+const diag::Template &
+DiagnosticsEngine::getTemplate(unsigned DiagID) {
+  return Templates[DiagID];
 }
 
 SourceMgr::DiagKind
 DiagnosticsEngine::getDiagnosticKind(unsigned DiagID) {
   return DiagnosticKind[DiagID];
-}
\ No newline at end of file
+}
+
+StringRef DiagnosticsEngine::format(unsigned DiagID,
+                                    llvm::ArrayRef<DiagArg> Args) {
+  const diag::Template &T = getTemplate(DiagID);
+  assert(Args.size() == T.NumArgs &&
+         "Wrong number of diagnostic arguments");
+  Buffer.clear();
+  for (unsigned I = 0; I < T.NumPieces; ++I) {
+    const diag::Template::Piece &P = T.Pieces[I];
+    Buffer.append(P.Text, P.Text + P.Length);
+    if (P.Arg >= 0)
+      Args[P.Arg].appendTo(Buffer);
+  }
+  return Buffer;
+}
+
+void DiagnosticsEngine::report(SMLoc Loc, unsigned DiagID,
+                               llvm::ArrayRef<DiagArg> Args) {
+  SourceMgr::DiagKind Kind = getDiagnosticKind(DiagID);
+  SrcMgr.PrintMessage(Loc, Kind, format(DiagID, Args));
+  NumErrors += (Kind == SourceMgr::DK_Error);
+}
+
+void DiagnosticsEngine::report(StringRef FileName, unsigned Line,
+                               unsigned Column, StringRef LineText,
+                               unsigned DiagID,
+                               llvm::ArrayRef<DiagArg> Args) {
+  report(llvm::SMDiagnostic(SrcMgr, SMLoc(), FileName, Line, Column,
+                            getDiagnosticKind(DiagID),
+                            format(DiagID, Args), LineText, {}));
+}
@@ -1,4 +1,7 @@
 #include "tinylang/Lexer/Lexer.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MathExtras.h"
+#include <optional>
 
 using namespace tinylang;
 
@@ -13,6 +16,16 @@ void KeywordFilter::addKeywords() {
 #include "tinylang/Basic/TokenKinds.def"
 }
 
+const KeywordFilter &KeywordFilter::getKeywords() {
+  // Initialization of a function-local static is thread-safe
+  static const KeywordFilter Keywords = [] {
+    KeywordFilter Filter;
+    Filter.addKeywords();
+    return Filter;
+  }();
+  return Keywords;
+}
+
 namespace charinfo {
 /* 
    A function prepended with this macro does not read or write any memory, except
@@ -56,12 +69,74 @@ LLVM_READNONE inline bool isIdentifierBody(char Ch) {
 }
 } // namespace charinfo
 
-void Lexer::next(Token &Result) {
-  while (*CurPtr && charinfo::isWhitespace(*CurPtr)) {
-    ++CurPtr;
+/*
+   Integer literals are converted eight digits at a time: the digits
+   are loaded into one 64 bit word and combined in parallel inside the
+   register (SWAR, "SIMD within a register"). The first digit ends up
+   in the lowest byte. Callers guarantee that all eight characters are
+   valid digits of the respective base.
+*/
+namespace swar {
+LLVM_READONLY inline uint32_t parseEightDecimalDigits(const char *P) {
+  uint64_t V = llvm::support::endian::read64le(P);
+  V -= 0x3030303030303030ULL;
+  // Every byte now combines two digits: d0 * 10 + d1, ...
+  V = (V * 10) + (V >> 8);
+  V = (((V & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+       (((V >> 16) & 0x000000FF000000FFULL) *
+        (1 + (10000ULL << 32)))) >>
+      32;
+  return static_cast<uint32_t>(V);
+}
+
+LLVM_READONLY inline uint32_t parseEightHexDigits(const char *P) {
+  uint64_t V = llvm::support::endian::read64le(P);
+  // '0'-'9' is 0x30-0x39 and 'A'-'F' is 0x41-0x46, so the low nibble
+  // is the digit value, plus 9 if bit 6 is set.
+  V = (V & 0x0F0F0F0F0F0F0F0FULL) +
+      9 * ((V >> 6) & 0x0101010101010101ULL);
+  // Merge neighbouring nibbles, then bytes, then 16 bit halves.
+  V = ((V << 4) | (V >> 8)) & 0x00FF00FF00FF00FFULL;
+  V = ((V << 8) | (V >> 16)) & 0x0000FFFF0000FFFFULL;
+  V = ((V << 16) | (V >> 32)) & 0x00000000FFFFFFFFULL;
+  return static_cast<uint32_t>(V);
+}
+
+/// Converts the digits in [Begin, End) to an integer. Returns false
+/// if the value does not fit into 64 bits.
+bool parseInteger(const char *Begin, const char *End, bool IsHex,
+                  uint64_t &Value) {
+  const uint64_t Chunk = IsHex ? 1ULL << 32 : 100000000;
+  const uint64_t Base = IsHex ? 16 : 10;
+  bool Overflow = false;
+  Value = 0;
+  for (; End - Begin >= 8 && !Overflow; Begin += 8)
+    Value = llvm::SaturatingMultiplyAdd<uint64_t>(
+        Value, Chunk,
+        IsHex ? parseEightHexDigits(Begin)
+              : parseEightDecimalDigits(Begin),
+        &Overflow);
+  for (; Begin != End && !Overflow; ++Begin) {
+    uint64_t Digit = charinfo::isDigit(*Begin) ? *Begin - '0'
+                                               : *Begin - 'A' + 10;
+    Value = llvm::SaturatingMultiplyAdd<uint64_t>(Value, Base,
+                                                  Digit, &Overflow);
   }
+  return !Overflow;
+}
+} // namespace swar
+
+void Lexer::next(Token &Result) {
+  do {
+    while (*CurPtr && charinfo::isWhitespace(*CurPtr)) {
+      ++CurPtr;
+    }
+  } while (fill(CurPtr));
+  // Some tokens are recognized by their second character.
+  fill(CurPtr, 1);
   if (!*CurPtr) {
-    Result.setKind(tok::eof);
+    // The parser reports errors at the end of the input, too.
+    formToken(Result, CurPtr, tok::eof);
     return;
   }
   if (charinfo::isIdentifierHead(*CurPtr)) {
@@ -116,18 +191,19 @@ void Lexer::next(Token &Result) {
         formToken(Result, CurPtr + 1, tok::greater);
       break;
     default:
-      Result.setKind(tok::unknown);
+      formToken(Result, CurPtr + 1, tok::unknown);
     }
     return;
   }
 }
 
 void Lexer::identifier(Token &Result) {
-  const char *Start = CurPtr;
   const char *End = CurPtr + 1;
-  while (charinfo::isIdentifierBody(*End))
-    ++End;
-  StringRef Name(Start, End - Start);
+  do {
+    while (charinfo::isIdentifierBody(*End))
+      ++End;
+  } while (fill(End));
+  StringRef Name(CurPtr, End - CurPtr);
   formToken(Result, End,
             Keywords.getKeyword(Name, tok::identifier));
 }
@@ -136,45 +212,70 @@ void Lexer::number(Token &Result) {
   const char *End = CurPtr + 1;
   tok::TokenKind Kind = tok::unknown;
   bool IsHex = false;
-  while (*End) {
-    if (!charinfo::isHexDigit(*End))
-      break;
-    if (!charinfo::isDigit(*End))
-      IsHex = true;
-    ++End;
-  }
+  do {
+    while (*End) {
+      if (!charinfo::isHexDigit(*End))
+        break;
+      if (!charinfo::isDigit(*End))
+        IsHex = true;
+      ++End;
+    }
+  } while (fill(End));
+  const char *DigitsEnd = End;
+  bool IsHexLiteral = false;
   switch (*End) {
   case 'H': /* hex number */
     Kind = tok::integer_literal;
+    IsHexLiteral = true;
     ++End;
     break;
   default: /* decimal number */
     if (IsHex)
-      Diags.report(getLoc(),
-                   diag::err_hex_digit_in_decimal);
+      report(CurPtr, diag::err_hex_digit_in_decimal);
     Kind = tok::integer_literal;
     break;
   }
+  // The value is computed only once, here. A decimal number with hex
+  // digits has already been reported and gets the value 0.
+  Result.IntValue = 0;
+  if ((IsHexLiteral || !IsHex) &&
+      !swar::parseInteger(CurPtr, DigitsEnd, IsHexLiteral,
+                          Result.IntValue))
+    report(CurPtr, diag::err_integer_literal_too_large);
   formToken(Result, End, Kind);
 }
 
 void Lexer::string(Token &Result) {
-  const char *Start = CurPtr;
   const char *End = CurPtr + 1;
-  while (*End && *End != *Start &&
-         !charinfo::isVerticalWhitespace(*End))
-    ++End;
-  if (charinfo::isVerticalWhitespace(*End)) {
-    Diags.report(getLoc(),
-                 diag::err_unterminated_char_or_string);
+  do {
+    while (*End && *End != *CurPtr &&
+           !charinfo::isVerticalWhitespace(*End))
+      ++End;
+  } while (fill(End));
+  if (!*End || charinfo::isVerticalWhitespace(*End)) {
+    report(CurPtr, diag::err_unterminated_char_or_string);
   }
-  formToken(Result, End + 1, tok::string_literal);
+  // At the end of the input, the terminating null character must
+  // not become part of the token.
+  formToken(Result, *End ? End + 1 : End, tok::string_literal);
 }
 
 void Lexer::comment() {
   const char *End = CurPtr + 2;
   unsigned Level = 1;
-  while (*End && Level) {
+  // When streaming, the part of the comment read so far is dropped
+  // before reading more input, so a long comment doesn't have to
+  // fit into memory. Only the location of its start is kept.
+  std::optional<StreamBuffer::Location> Start;
+  while (Level) {
+    if (Stream && End + 1 >= CurBuf.end() && !Stream->atEOF()) {
+      if (!Start)
+        Start = Stream->getLocation(CurPtr);
+      CurPtr = End;
+      fill(End, 1);
+    }
+    if (!*End)
+      break;
     // Check for nested comment.
     if (*End == '(' && *(End + 1) == '*') {
       End += 2;
@@ -187,9 +288,13 @@ void Lexer::comment() {
     } else
       ++End;
   }
-  if (!*End) {
-    Diags.report(getLoc(),
-                 diag::err_unterminated_block_comment);
+  if (Level) {
+    if (Start)
+      Diags.report(Stream->getName(), Start->Line, Start->Column,
+                   Start->LineText,
+                   diag::err_unterminated_block_comment);
+    else
+      report(CurPtr, diag::err_unterminated_block_comment);
   }
   CurPtr = End;
 }
@@ -201,4 +306,29 @@ void Lexer::formToken(Token &Result, const char *TokEnd,
   Result.Length = TokLen;
   Result.Kind = Kind;
   CurPtr = TokEnd;
-}
\ No newline at end of file
+}
+
+void Lexer::report(const char *Ptr, unsigned DiagID) {
+  if (!Stream) {
+    Diags.report(SMLoc::getFromPointer(Ptr), DiagID);
+    return;
+  }
+  StreamBuffer::Location Loc = Stream->getLocation(Ptr);
+  Diags.report(Stream->getName(), Loc.Line, Loc.Column,
+               Loc.LineText, DiagID);
+}
+
+bool Lexer::fill(const char *&Ptr, unsigned Lookahead) {
+  if (!Stream)
+    return false;
+  bool Filled = false;
+  // A read may return less than a chunk, e.g. from a pipe.
+  while (Ptr + Lookahead >= CurBuf.end() && !Stream->atEOF()) {
+    size_t Offset = Ptr - CurPtr;
+    Filled |= Stream->refill(CurPtr) != 0;
+    CurBuf =
+        StringRef(Stream->begin(), Stream->end() - Stream->begin());
+    Ptr = CurPtr + Offset;
+  }
+  return Filled;
+}
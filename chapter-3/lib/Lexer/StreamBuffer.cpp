@@ -0,0 +1,115 @@
+#include "tinylang/Lexer/StreamBuffer.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iterator>
+
+using namespace tinylang;
+
+StreamBuffer::StreamBuffer(llvm::sys::fs::file_t File,
+                           bool OwnsFile, StringRef Name,
+                           size_t ChunkSize)
+    : File(File), OwnsFile(OwnsFile), Name(Name.str()),
+      ChunkSize(std::max<size_t>(ChunkSize, 1)), Data(1, '\0') {}
+
+StreamBuffer::~StreamBuffer() {
+  if (OwnsFile)
+    llvm::sys::fs::closeFile(File);
+}
+
+llvm::Expected<std::unique_ptr<StreamBuffer>>
+StreamBuffer::open(StringRef FileName, size_t ChunkSize) {
+  if (FileName == "-")
+    return std::unique_ptr<StreamBuffer>(
+        new StreamBuffer(llvm::sys::fs::getStdinHandle(),
+                         /*OwnsFile=*/false, "<stdin>", ChunkSize));
+  llvm::Expected<llvm::sys::fs::file_t> FileOrErr =
+      llvm::sys::fs::openNativeFileForRead(FileName);
+  if (!FileOrErr)
+    return FileOrErr.takeError();
+  return std::unique_ptr<StreamBuffer>(new StreamBuffer(
+      *FileOrErr, /*OwnsFile=*/true, FileName, ChunkSize));
+}
+
+namespace {
+/// Up to this many bytes before the current token are kept, if they
+/// belong to the same line.
+const size_t MaxLineContext = 256;
+} // namespace
+
+size_t StreamBuffer::refill(const char *&Keep) {
+  assert(Keep >= begin() && Keep <= end() &&
+         "Keep must point into the window");
+  if (AtEOF)
+    return 0;
+
+  const char *KeepFrom = Keep;
+  while (KeepFrom != begin() &&
+         static_cast<size_t>(Keep - KeepFrom) < MaxLineContext &&
+         KeepFrom[-1] != '\n')
+    --KeepFrom;
+  if (KeepFrom != begin() && KeepFrom[-1] != '\n')
+    KeepFrom = Keep;
+
+  // Account for the discarded lines, for getLocation().
+  size_t Discarded = KeepFrom - begin();
+  std::reverse_iterator<const char *> RBegin(KeepFrom), REnd(begin());
+  auto LastNewline = std::find(RBegin, REnd, '\n');
+  if (LastNewline != REnd) {
+    DiscardedLines += std::count(begin(), KeepFrom, '\n');
+    // base() is the character after the newline.
+    DiscardedColumns = KeepFrom - LastNewline.base();
+  } else
+    DiscardedColumns += Discarded;
+  DiscardedBytes += Discarded;
+
+  size_t KeepOffset = Keep - KeepFrom;
+  Size -= Discarded;
+  memmove(Data.data(), KeepFrom, Size);
+  // The window only grows if a token doesn't fit into one chunk.
+  if (Data.size() < Size + ChunkSize + 1)
+    Data.resize(Size + ChunkSize + 1);
+  Keep = Data.data() + KeepOffset;
+
+  size_t Read = 0;
+  for (;;) {
+    llvm::Expected<size_t> ReadOrErr = llvm::sys::fs::readNativeFile(
+        File, llvm::MutableArrayRef<char>(Data.data() + Size, ChunkSize));
+    if (!ReadOrErr) {
+      // Reads interrupted by a signal are retried, and don't count
+      // as errors.
+      std::error_code EC = llvm::errorToErrorCode(ReadOrErr.takeError());
+      if (EC == std::errc::interrupted)
+        continue;
+      ReadError = EC;
+      AtEOF = true;
+    } else if (*ReadOrErr == 0)
+      AtEOF = true;
+    else
+      Read = *ReadOrErr;
+    break;
+  }
+  Size += Read;
+  Data[Size] = '\0';
+  return Read;
+}
+
+StreamBuffer::Location
+StreamBuffer::getLocation(const char *Ptr) const {
+  const char *LineStart = Ptr;
+  while (LineStart != begin() && LineStart[-1] != '\n')
+    --LineStart;
+  const char *LineEnd = Ptr;
+  while (LineEnd != end() && *LineEnd != '\n' && *LineEnd != '\r')
+    ++LineEnd;
+  Location Loc;
+  Loc.Line = DiscardedLines + 1 + std::count(begin(), Ptr, '\n');
+  Loc.Column = Ptr - LineStart;
+  if (LineStart == begin() && DiscardedColumns) {
+    // The caret could not be placed in a partial line.
+    Loc.Column += DiscardedColumns;
+    return Loc;
+  }
+  Loc.LineText.assign(LineStart, LineEnd);
+  return Loc;
+}
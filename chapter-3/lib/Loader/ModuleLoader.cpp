@@ -0,0 +1,339 @@
+#include "tinylang/Loader/ModuleLoader.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+using namespace tinylang;
+
+namespace {
+/// First line of a cached interface. Bump the version whenever
+/// the format or the scanner changes, to invalidate old entries.
+const char CacheHeader[] = "tinylang-interface 1";
+} // namespace
+
+/*
+   The scanner only needs to know the nesting level: declarations
+   with a level of 0 belong to the module. PROCEDURE, IF and WHILE
+   each open a level which is closed by one END. The BEGIN of the
+   module body (or its END, if it has no body) ends the declarations.
+*/
+ModuleInterface ModuleInterface::scan(Lexer &Lex) {
+  ModuleInterface Result;
+  const char *BufferStart = Lex.getBuffer().begin();
+  auto AddImport = [&](Token &Tok) {
+    Result.Imports.push_back(
+        {Tok.getIdentifier().str(),
+         static_cast<size_t>(Tok.getLocation().getPointer() -
+                             BufferStart)});
+  };
+
+  Token Tok;
+  Lex.next(Tok);
+  if (Tok.is(tok::kw_MODULE)) {
+    Lex.next(Tok);
+    if (Tok.is(tok::identifier)) {
+      Result.Name = Tok.getIdentifier().str();
+      Lex.next(Tok);
+    }
+  }
+
+  // [ "FROM" identifier ] "IMPORT" identList ";"
+  while (Tok.isOneOf(tok::semi, tok::kw_FROM, tok::kw_IMPORT)) {
+    if (Tok.is(tok::kw_FROM)) {
+      Lex.next(Tok);
+      if (Tok.is(tok::identifier))
+        AddImport(Tok);
+      while (!Tok.isOneOf(tok::semi, tok::eof))
+        Lex.next(Tok);
+    } else if (Tok.is(tok::kw_IMPORT)) {
+      Lex.next(Tok);
+      while (Tok.is(tok::identifier)) {
+        AddImport(Tok);
+        Lex.next(Tok);
+        if (Tok.isNot(tok::comma))
+          break;
+        Lex.next(Tok);
+      }
+    } else
+      Lex.next(Tok);
+  }
+
+  unsigned Level = 0;
+  tok::TokenKind Section = tok::unknown;
+  // True if the next identifier starts a declaration of the
+  // current CONST or VAR section.
+  bool AtName = false;
+  bool AfterName = false;
+  for (; Tok.isNot(tok::eof); Lex.next(Tok)) {
+    if (Level > 0) {
+      if (Tok.isOneOf(tok::kw_PROCEDURE, tok::kw_IF, tok::kw_WHILE))
+        ++Level;
+      else if (Tok.is(tok::kw_END))
+        --Level;
+      continue;
+    }
+    bool WasName = AfterName;
+    AfterName = false;
+    switch (Tok.getKind()) {
+    case tok::kw_BEGIN:
+    case tok::kw_END:
+      return Result;
+    case tok::kw_CONST:
+    case tok::kw_VAR:
+      Section = Tok.getKind();
+      AtName = true;
+      break;
+    case tok::kw_PROCEDURE:
+      Lex.next(Tok);
+      if (Tok.is(tok::identifier))
+        Result.Decls.push_back(
+            {Procedure, Tok.getIdentifier().str()});
+      Section = tok::unknown;
+      AtName = false;
+      Level = 1;
+      break;
+    case tok::semi:
+      AtName = Section != tok::unknown;
+      break;
+    case tok::comma:
+      // VAR a, b : INTEGER;
+      AtName = WasName && Section == tok::kw_VAR;
+      break;
+    case tok::identifier:
+      if (AtName) {
+        Result.Decls.push_back(
+            {Section == tok::kw_CONST ? Const : Var,
+             Tok.getIdentifier().str()});
+        AfterName = true;
+      }
+      AtName = false;
+      break;
+    default:
+      AtName = false;
+      break;
+    }
+  }
+  return Result;
+}
+
+void ModuleInterface::write(raw_ostream &OS) const {
+  static const char *const DeclNames[] = {"const", "var",
+                                          "procedure"};
+  OS << CacheHeader << "\n";
+  OS << "module " << Name << "\n";
+  for (const Import &I : Imports)
+    OS << "import " << I.Module << " " << I.Offset << "\n";
+  for (const Decl &D : Decls)
+    OS << DeclNames[D.Kind] << " " << D.Name << "\n";
+}
+
+bool ModuleInterface::read(StringRef Text,
+                           ModuleInterface &Result) {
+  llvm::SmallVector<StringRef, 32> Lines;
+  Text.split(Lines, '\n', -1, /*KeepEmpty=*/false);
+  if (Lines.size() < 2 || Lines[0] != CacheHeader ||
+      !Lines[1].consume_front("module "))
+    return false;
+  Result = ModuleInterface();
+  Result.Name = Lines[1].str();
+  for (StringRef Line : llvm::ArrayRef<StringRef>(Lines).drop_front(2)) {
+    StringRef Kind, Rest;
+    std::tie(Kind, Rest) = Line.split(' ');
+    if (Kind == "import") {
+      StringRef Module, Offset;
+      std::tie(Module, Offset) = Rest.split(' ');
+      size_t Value;
+      if (Module.empty() || Offset.getAsInteger(10, Value))
+        return false;
+      Result.Imports.push_back({Module.str(), Value});
+    } else if (Kind == "const")
+      Result.Decls.push_back({Const, Rest.str()});
+    else if (Kind == "var")
+      Result.Decls.push_back({Var, Rest.str()});
+    else if (Kind == "procedure")
+      Result.Decls.push_back({Procedure, Rest.str()});
+    else
+      return false;
+  }
+  return true;
+}
+
+/// The work of loading one module, done on a worker thread. The
+/// results are handed to the shared SourceMgr and DiagnosticsEngine
+/// by the thread calling loadImports().
+struct ModuleLoader::Job {
+  std::string Name;
+  SMLoc ImportLoc;
+  /// The source, once found. Preset for the module passed to
+  /// loadImports(), which is already in the SourceMgr.
+  const llvm::MemoryBuffer *Buffer = nullptr;
+  std::unique_ptr<llvm::MemoryBuffer> Owned;
+  std::string Path;
+  std::error_code ReadError;
+  uint64_t Hash = 0;
+  bool Cached = false;
+  ModuleInterface Interface;
+  /// Diagnostics of the lexer, to be reported in the SourceMgr
+  /// the source is finally added to.
+  std::vector<llvm::SMDiagnostic> Diagnostics;
+};
+
+ModuleLoader::ModuleLoader(SourceMgr &SrcMgr,
+                           DiagnosticsEngine &Diags,
+                           unsigned NumThreads)
+    : SrcMgr(SrcMgr), Diags(Diags),
+      Pool(llvm::hardware_concurrency(NumThreads)) {}
+
+void ModuleLoader::run(Job &J) {
+  for (auto I = SearchPaths.begin(), E = SearchPaths.end();
+       !J.Buffer && I != E; ++I) {
+    llvm::SmallString<128> Path(*I);
+    llvm::sys::path::append(Path, J.Name + ".mod");
+    // Large files are memory mapped instead of copied.
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr =
+        llvm::MemoryBuffer::getFile(Path);
+    if (!FileOrErr) {
+      if (FileOrErr.getError() ==
+          std::errc::no_such_file_or_directory)
+        continue;
+      J.ReadError = FileOrErr.getError();
+      return;
+    }
+    J.Owned = std::move(*FileOrErr);
+    J.Buffer = J.Owned.get();
+    J.Path = std::string(Path);
+  }
+  if (!J.Buffer)
+    return;
+
+  J.Hash = llvm::xxHash64(J.Buffer->getBuffer());
+  if (readCached(J)) {
+    J.Cached = true;
+    return;
+  }
+
+  // SourceMgr isn't thread-safe, so the lexer gets a private one,
+  // referring to the same memory.
+  SourceMgr PrivateMgr;
+  PrivateMgr.setDiagHandler(
+      [](const llvm::SMDiagnostic &Diag, void *Context) {
+        static_cast<std::vector<llvm::SMDiagnostic> *>(Context)
+            ->push_back(Diag);
+      },
+      &J.Diagnostics);
+  PrivateMgr.AddNewSourceBuffer(
+      llvm::MemoryBuffer::getMemBuffer(J.Buffer->getMemBufferRef()),
+      SMLoc());
+  DiagnosticsEngine PrivateDiags(PrivateMgr);
+  Lexer Lex(PrivateMgr, PrivateDiags);
+  J.Interface = ModuleInterface::scan(Lex);
+  // Sources with errors are lexed again next time, so the
+  // errors are reported again.
+  if (!PrivateDiags.numErrors())
+    writeCached(J);
+}
+
+static llvm::SmallString<128> getCachePath(StringRef CacheDir,
+                                           uint64_t Hash) {
+  llvm::SmallString<32> Name;
+  llvm::raw_svector_ostream(Name)
+      << llvm::format_hex_no_prefix(Hash, 16) << ".tli";
+  llvm::SmallString<128> Path(CacheDir);
+  llvm::sys::path::append(Path, Name);
+  return Path;
+}
+
+bool ModuleLoader::readCached(Job &J) {
+  if (CacheDir.empty())
+    return false;
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr =
+      llvm::MemoryBuffer::getFile(getCachePath(CacheDir, J.Hash));
+  return FileOrErr &&
+         ModuleInterface::read((*FileOrErr)->getBuffer(),
+                               J.Interface);
+}
+
+void ModuleLoader::writeCached(const Job &J) {
+  if (CacheDir.empty())
+    return;
+  // writeToOutput() writes a temporary file and renames it, so
+  // concurrent compilers sharing the cache never see partial
+  // files. A failure only costs a cache miss next time.
+  llvm::consumeError(llvm::writeToOutput(
+      getCachePath(CacheDir, J.Hash), [&J](llvm::raw_ostream &OS) {
+        J.Interface.write(OS);
+        return llvm::Error::success();
+      }));
+}
+
+bool ModuleLoader::loadImports(unsigned BufferID) {
+  if (!CacheDir.empty())
+    llvm::sys::fs::create_directories(CacheDir);
+  unsigned NumErrors = Diags.numErrors();
+
+  std::vector<std::unique_ptr<Job>> Round;
+  Round.push_back(std::make_unique<Job>());
+  Round.back()->Buffer = SrcMgr.getMemoryBuffer(BufferID);
+  llvm::StringSet<> Requested;
+
+  while (!Round.empty()) {
+    for (std::unique_ptr<Job> &J : Round)
+      Pool.async([this, Ptr = J.get()] { run(*Ptr); });
+    Pool.wait();
+
+    // The results are processed in the order the imports were
+    // found, so the buffer IDs and diagnostics don't depend on
+    // the scheduling of the threads.
+    std::vector<std::unique_ptr<Job>> Next;
+    for (std::unique_ptr<Job> &J : Round) {
+      if (J->ReadError) {
+        Diags.report(J->ImportLoc, diag::err_module_not_readable,
+                     J->Name, J->ReadError.message());
+        continue;
+      }
+      if (!J->Buffer) {
+        Diags.report(J->ImportLoc, diag::err_module_not_found,
+                     J->Name);
+        continue;
+      }
+
+      auto M = std::make_unique<Module>();
+      M->BufferID = J->Owned ? SrcMgr.AddNewSourceBuffer(
+                                   std::move(J->Owned), J->ImportLoc)
+                             : BufferID;
+      for (const llvm::SMDiagnostic &Diag : J->Diagnostics)
+        Diags.report(Diag);
+      if (J->Name.empty())
+        J->Name = J->Interface.Name;
+      else if (J->Interface.Name != J->Name)
+        Diags.report(J->ImportLoc, diag::err_module_name_mismatch,
+                     J->Name, J->Interface.Name);
+      M->Name = J->Name;
+      M->Path = std::move(J->Path);
+      M->Hash = J->Hash;
+      M->Cached = J->Cached;
+      M->Interface = std::move(J->Interface);
+
+      StringRef Source =
+          SrcMgr.getMemoryBuffer(M->BufferID)->getBuffer();
+      for (const ModuleInterface::Import &I : M->Interface.Imports) {
+        if (Modules.count(I.Module) || I.Module == M->Name ||
+            !Requested.insert(I.Module).second)
+          continue;
+        Next.push_back(std::make_unique<Job>());
+        Next.back()->Name = I.Module;
+        Next.back()->ImportLoc = SMLoc::getFromPointer(
+            Source.begin() + std::min(I.Offset, Source.size()));
+      }
+      LoadOrder.push_back(M.get());
+      Modules[LoadOrder.back()->Name] = std::move(M);
+    }
+    Round = std::move(Next);
+  }
+  return Diags.numErrors() == NumErrors;
+}
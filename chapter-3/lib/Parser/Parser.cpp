@@ -0,0 +1,667 @@
+#include "tinylang/Parser/Parser.h"
+#include "llvm/ADT/STLExtras.h"
+
+using namespace tinylang;
+
+/*
+   Every parse function returns true if it found an error which it
+   did not handle itself. A function handles an error by skipping to
+   the follow set of its rule, and returns false then: the caller
+   carries on as if the rule had been parsed. Only the helpers for
+   qualified identifiers and identifier lists leave the recovery to
+   their callers, as they appear in too many contexts.
+
+   An expression with an error is nullptr, and a statement or
+   declaration containing one is not added to the AST.
+
+   The follow sets are computed from the grammar and stored as
+   bitmasks, so skipping a token costs a shift and a test.
+*/
+namespace {
+constexpr TokenSet FollowCompilationUnit{tok::eof};
+constexpr TokenSet FollowImport{
+    tok::kw_FROM,      tok::kw_IMPORT, tok::kw_CONST, tok::kw_VAR,
+    tok::kw_PROCEDURE, tok::kw_BEGIN,  tok::kw_END};
+constexpr TokenSet FollowBlock{tok::identifier};
+constexpr TokenSet FollowDeclaration{tok::kw_CONST, tok::kw_VAR,
+                                     tok::kw_PROCEDURE,
+                                     tok::kw_BEGIN, tok::kw_END};
+constexpr TokenSet FollowDeclarationItem{tok::semi};
+constexpr TokenSet FollowFormalParameters{tok::semi};
+constexpr TokenSet FollowFormalParameterList{tok::r_paren};
+constexpr TokenSet FollowFormalParameter{tok::semi, tok::r_paren};
+constexpr TokenSet FollowStatementSequence{tok::kw_ELSE,
+                                           tok::kw_END};
+constexpr TokenSet FollowStatement{tok::semi, tok::kw_ELSE,
+                                   tok::kw_END};
+constexpr TokenSet FirstStatement{tok::identifier, tok::kw_IF,
+                                  tok::kw_WHILE, tok::kw_RETURN};
+constexpr TokenSet FollowExpList{tok::r_paren};
+constexpr TokenSet FollowExpression{
+    tok::r_paren, tok::comma,   tok::semi,   tok::kw_THEN,
+    tok::kw_DO,   tok::kw_ELSE, tok::kw_END};
+
+constexpr TokenSet RelationOps{tok::equal,     tok::hash,
+                               tok::less,      tok::lessequal,
+                               tok::greater,   tok::greaterequal};
+constexpr TokenSet AddOps{tok::plus, tok::minus, tok::kw_OR};
+constexpr TokenSet MulOps{tok::star, tok::slash, tok::kw_DIV,
+                          tok::kw_MOD, tok::kw_AND};
+
+constexpr TokenSet FollowSimpleExpression =
+    FollowExpression | RelationOps;
+constexpr TokenSet FollowTerm = FollowSimpleExpression | AddOps;
+constexpr TokenSet FollowFactor = FollowTerm | MulOps;
+
+const char *getSpelling(tok::TokenKind Kind) {
+  if (const char *Spelling = tok::getPunctuatorSpelling(Kind))
+    return Spelling;
+  if (const char *Spelling = tok::getKeywordSpelling(Kind))
+    return Spelling;
+  return tok::getTokenName(Kind);
+}
+
+Ident getIdent(const Token &Tok) {
+  return {Tok.getLocation(), Tok.getIdentifier()};
+}
+} // namespace
+
+void Parser::error(const char *Expected) {
+  // At the end of the input, every open rule fails. Only the
+  // innermost one is reported.
+  if (tok().is(tok::eof)) {
+    if (ReportedEOF)
+      return;
+    ReportedEOF = true;
+  }
+  Diags.report(tok().getLocation(), diag::err_expected, Expected,
+               getSpelling(tok().getKind()));
+}
+
+void Parser::error(tok::TokenKind Expected) {
+  error(getSpelling(Expected));
+}
+
+bool Parser::expect(tok::TokenKind Kind) {
+  if (tok().is(Kind))
+    return false;
+  error(Kind);
+  if (tok().isNot(tok::eof) && peek(1).is(Kind)) {
+    advance();
+    return false;
+  }
+  return true;
+}
+
+bool Parser::skipUntil(TokenSet Follow) {
+  while (!Follow.contains(tok().getKind()) &&
+         tok().isNot(tok::eof))
+    advance();
+  return false;
+}
+
+ModuleDeclaration *Parser::parse() {
+  ModuleDeclaration *D = nullptr;
+  parseCompilationUnit(D);
+  return D;
+}
+
+bool Parser::parseCompilationUnit(ModuleDeclaration *&D) {
+  auto ErrorHandler = [this] {
+    return skipUntil(FollowCompilationUnit);
+  };
+  if (consume(tok::kw_MODULE))
+    return ErrorHandler();
+  if (expect(tok::identifier))
+    return ErrorHandler();
+  Ident Name = getIdent(tok());
+  advance();
+  if (consume(tok::semi))
+    return ErrorHandler();
+
+  llvm::SmallVector<Import, 8> Imports;
+  while (tok().isOneOf(tok::kw_FROM, tok::kw_IMPORT)) {
+    if (parseImport(Imports))
+      return ErrorHandler();
+  }
+  DeclList Decls;
+  StmtList Stmts;
+  if (parseBlock(Decls, Stmts))
+    return ErrorHandler();
+  D = Ctx.create<ModuleDeclaration>(Name.Loc, Name.Name,
+                                    copy(Imports), Decls, Stmts);
+
+  if (expect(tok::identifier))
+    return ErrorHandler();
+  if (Name.Name != tok().getIdentifier()) {
+    Diags.report(tok().getLocation(),
+                 diag::err_module_identifier_not_equal);
+    Diags.report(Name.Loc,
+                 diag::note_module_identifier_declaration);
+  }
+  advance();
+  if (consume(tok::period))
+    return ErrorHandler();
+  // Nothing may follow the module.
+  if (expect(tok::eof))
+    return ErrorHandler();
+  return false;
+}
+
+bool Parser::parseImport(llvm::SmallVectorImpl<Import> &Imports) {
+  auto ErrorHandler = [this] { return skipUntil(FollowImport); };
+  SMLoc Loc = tok().getLocation();
+  StringRef From;
+  if (tok().is(tok::kw_FROM)) {
+    advance();
+    if (expect(tok::identifier))
+      return ErrorHandler();
+    From = tok().getIdentifier();
+    advance();
+  }
+  if (consume(tok::kw_IMPORT))
+    return ErrorHandler();
+  llvm::SmallVector<Ident, 8> Ids;
+  if (parseIdentList(Ids))
+    return ErrorHandler();
+  if (expect(tok::semi))
+    return ErrorHandler();
+  Imports.push_back({Loc, From, copy(Ids)});
+  advance();
+  return false;
+}
+
+bool Parser::parseBlock(DeclList &Decls, StmtList &Stmts) {
+  auto ErrorHandler = [this] { return skipUntil(FollowBlock); };
+  llvm::SmallVector<Decl *, 16> DeclVec;
+  while (tok().isOneOf(tok::kw_CONST, tok::kw_VAR,
+                       tok::kw_PROCEDURE)) {
+    if (parseDeclaration(DeclVec))
+      return ErrorHandler();
+  }
+  Decls = copy(DeclVec);
+  if (tok().is(tok::kw_BEGIN)) {
+    advance();
+    if (parseStatementSequence(Stmts))
+      return ErrorHandler();
+  }
+  if (consume(tok::kw_END))
+    return ErrorHandler();
+  return false;
+}
+
+bool Parser::parseDeclaration(llvm::SmallVectorImpl<Decl *> &Decls) {
+  auto ErrorHandler = [this] {
+    return skipUntil(FollowDeclaration);
+  };
+  if (tok().is(tok::kw_CONST)) {
+    advance();
+    while (tok().is(tok::identifier)) {
+      if (parseConstantDeclaration(Decls))
+        return ErrorHandler();
+      if (consume(tok::semi))
+        return ErrorHandler();
+    }
+  } else if (tok().is(tok::kw_VAR)) {
+    advance();
+    while (tok().is(tok::identifier)) {
+      if (parseVariableDeclaration(Decls))
+        return ErrorHandler();
+      if (consume(tok::semi))
+        return ErrorHandler();
+    }
+  } else if (tok().is(tok::kw_PROCEDURE)) {
+    if (parseProcedureDeclaration(Decls))
+      return ErrorHandler();
+    if (consume(tok::semi))
+      return ErrorHandler();
+  } else {
+    error("declaration");
+    return ErrorHandler();
+  }
+  return false;
+}
+
+bool Parser::parseConstantDeclaration(
+    llvm::SmallVectorImpl<Decl *> &Decls) {
+  auto ErrorHandler = [this] {
+    return skipUntil(FollowDeclarationItem);
+  };
+  if (expect(tok::identifier))
+    return ErrorHandler();
+  Ident Name = getIdent(tok());
+  advance();
+  if (consume(tok::equal))
+    return ErrorHandler();
+  Expr *E = nullptr;
+  if (parseExpression(E))
+    return ErrorHandler();
+  if (E)
+    Decls.push_back(
+        Ctx.create<ConstantDeclaration>(Name.Loc, Name.Name, E));
+  return false;
+}
+
+bool Parser::parseVariableDeclaration(
+    llvm::SmallVectorImpl<Decl *> &Decls) {
+  auto ErrorHandler = [this] {
+    return skipUntil(FollowDeclarationItem);
+  };
+  llvm::SmallVector<Ident, 8> Ids;
+  if (parseIdentList(Ids))
+    return ErrorHandler();
+  if (consume(tok::colon))
+    return ErrorHandler();
+  Qualident Type;
+  if (parseQualident(Type))
+    return ErrorHandler();
+  for (const Ident &Id : Ids)
+    Decls.push_back(
+        Ctx.create<VariableDeclaration>(Id.Loc, Id.Name, Type));
+  return false;
+}
+
+bool Parser::parseProcedureDeclaration(
+    llvm::SmallVectorImpl<Decl *> &Decls) {
+  auto ErrorHandler = [this] {
+    return skipUntil(FollowDeclarationItem);
+  };
+  if (consume(tok::kw_PROCEDURE))
+    return ErrorHandler();
+  if (expect(tok::identifier))
+    return ErrorHandler();
+  Ident Name = getIdent(tok());
+  advance();
+  FormalParamList Params;
+  Qualident RetType;
+  if (tok().is(tok::l_paren)) {
+    if (parseFormalParameters(Params, RetType))
+      return ErrorHandler();
+  }
+  if (consume(tok::semi))
+    return ErrorHandler();
+  DeclList LocalDecls;
+  StmtList Stmts;
+  if (parseBlock(LocalDecls, Stmts))
+    return ErrorHandler();
+  if (expect(tok::identifier))
+    return ErrorHandler();
+  if (Name.Name != tok().getIdentifier()) {
+    Diags.report(tok().getLocation(),
+                 diag::err_proc_identifier_not_equal);
+    Diags.report(Name.Loc, diag::note_proc_identifier_declaration);
+  }
+  Decls.push_back(Ctx.create<ProcedureDeclaration>(
+      Name.Loc, Name.Name, Params, RetType, LocalDecls, Stmts));
+  advance();
+  return false;
+}
+
+bool Parser::parseFormalParameters(FormalParamList &Params,
+                                   Qualident &RetType) {
+  auto ErrorHandler = [this] {
+    return skipUntil(FollowFormalParameters);
+  };
+  if (consume(tok::l_paren))
+    return ErrorHandler();
+  llvm::SmallVector<FormalParameterDeclaration *, 8> ParamVec;
+  if (tok().isOneOf(tok::kw_VAR, tok::identifier)) {
+    if (parseFormalParameterList(ParamVec))
+      return ErrorHandler();
+  }
+  Params = copy(ParamVec);
+  if (consume(tok::r_paren))
+    return ErrorHandler();
+  if (tok().is(tok::colon)) {
+    advance();
+    if (parseQualident(RetType))
+      return ErrorHandler();
+  }
+  return false;
+}
+
+bool Parser::parseFormalParameterList(
+    llvm::SmallVectorImpl<FormalParameterDeclaration *> &Params) {
+  auto ErrorHandler = [this] {
+    return skipUntil(FollowFormalParameterList);
+  };
+  if (parseFormalParameter(Params))
+    return ErrorHandler();
+  while (tok().is(tok::semi)) {
+    advance();
+    if (parseFormalParameter(Params))
+      return ErrorHandler();
+  }
+  return false;
+}
+
+bool Parser::parseFormalParameter(
+    llvm::SmallVectorImpl<FormalParameterDeclaration *> &Params) {
+  auto ErrorHandler = [this] {
+    return skipUntil(FollowFormalParameter);
+  };
+  bool IsVar = false;
+  if (tok().is(tok::kw_VAR)) {
+    IsVar = true;
+    advance();
+  }
+  llvm::SmallVector<Ident, 8> Ids;
+  if (parseIdentList(Ids))
+    return ErrorHandler();
+  if (consume(tok::colon))
+    return ErrorHandler();
+  Qualident Type;
+  if (parseQualident(Type))
+    return ErrorHandler();
+  for (const Ident &Id : Ids)
+    Params.push_back(Ctx.create<FormalParameterDeclaration>(
+        Id.Loc, Id.Name, Type, IsVar));
+  return false;
+}
+
+bool Parser::parseStatementSequence(StmtList &Stmts) {
+  llvm::SmallVector<Stmt *, 16> StmtVec;
+  auto ErrorHandler = [&] {
+    Stmts = copy(StmtVec);
+    return skipUntil(FollowStatementSequence);
+  };
+  if (parseStatement(StmtVec))
+    return ErrorHandler();
+  while (true) {
+    if (tok().is(tok::semi))
+      advance();
+    else if (FollowStatementSequence.contains(tok().getKind()) ||
+             tok().is(tok::eof))
+      break;
+    else {
+      // A missing ";" in front of a statement is assumed to be
+      // there. Other tokens are skipped up to the next statement.
+      error(tok::semi);
+      if (!FirstStatement.contains(tok().getKind())) {
+        skipUntil(FollowStatement);
+        continue;
+      }
+    }
+    if (parseStatement(StmtVec))
+      return ErrorHandler();
+  }
+  Stmts = copy(StmtVec);
+  return false;
+}
+
+bool Parser::parseStatement(llvm::SmallVectorImpl<Stmt *> &Stmts) {
+  auto ErrorHandler = [this] { return skipUntil(FollowStatement); };
+  switch (tok().getKind()) {
+  case tok::identifier: {
+    SMLoc Loc = tok().getLocation();
+    Qualident Name;
+    if (parseQualident(Name))
+      return ErrorHandler();
+    if (tok().is(tok::colonequal)) {
+      advance();
+      Expr *E = nullptr;
+      if (parseExpression(E))
+        return ErrorHandler();
+      if (E)
+        Stmts.push_back(
+            Ctx.create<AssignmentStatement>(Loc, Name, E));
+      return false;
+    }
+    llvm::SmallVector<Expr *, 8> Params;
+    if (tok().is(tok::l_paren)) {
+      advance();
+      if (tok().isNot(tok::r_paren) && parseExpList(Params))
+        return ErrorHandler();
+      if (consume(tok::r_paren))
+        return ErrorHandler();
+    }
+    if (!llvm::is_contained(Params, nullptr))
+      Stmts.push_back(Ctx.create<ProcedureCallStatement>(
+          Loc, Name, copy(Params)));
+    return false;
+  }
+  case tok::kw_IF:
+    return parseIfStatement(Stmts);
+  case tok::kw_WHILE:
+    return parseWhileStatement(Stmts);
+  case tok::kw_RETURN:
+    return parseReturnStatement(Stmts);
+  default:
+    // The empty statement.
+    if (FollowStatement.contains(tok().getKind()))
+      return false;
+    error("statement");
+    return ErrorHandler();
+  }
+}
+
+bool Parser::parseIfStatement(llvm::SmallVectorImpl<Stmt *> &Stmts) {
+  auto ErrorHandler = [this] { return skipUntil(FollowStatement); };
+  SMLoc Loc = tok().getLocation();
+  if (consume(tok::kw_IF))
+    return ErrorHandler();
+  Expr *Cond = nullptr;
+  if (parseExpression(Cond))
+    return ErrorHandler();
+  if (consume(tok::kw_THEN))
+    return ErrorHandler();
+  StmtList IfStmts, ElseStmts;
+  if (parseStatementSequence(IfStmts))
+    return ErrorHandler();
+  if (tok().is(tok::kw_ELSE)) {
+    advance();
+    if (parseStatementSequence(ElseStmts))
+      return ErrorHandler();
+  }
+  if (consume(tok::kw_END))
+    return ErrorHandler();
+  if (Cond)
+    Stmts.push_back(
+        Ctx.create<IfStatement>(Loc, Cond, IfStmts, ElseStmts));
+  return false;
+}
+
+bool Parser::parseWhileStatement(
+    llvm::SmallVectorImpl<Stmt *> &Stmts) {
+  auto ErrorHandler = [this] { return skipUntil(FollowStatement); };
+  SMLoc Loc = tok().getLocation();
+  if (consume(tok::kw_WHILE))
+    return ErrorHandler();
+  Expr *Cond = nullptr;
+  if (parseExpression(Cond))
+    return ErrorHandler();
+  if (consume(tok::kw_DO))
+    return ErrorHandler();
+  StmtList WhileStmts;
+  if (parseStatementSequence(WhileStmts))
+    return ErrorHandler();
+  if (consume(tok::kw_END))
+    return ErrorHandler();
+  if (Cond)
+    Stmts.push_back(
+        Ctx.create<WhileStatement>(Loc, Cond, WhileStmts));
+  return false;
+}
+
+bool Parser::parseReturnStatement(
+    llvm::SmallVectorImpl<Stmt *> &Stmts) {
+  auto ErrorHandler = [this] { return skipUntil(FollowStatement); };
+  SMLoc Loc = tok().getLocation();
+  if (consume(tok::kw_RETURN))
+    return ErrorHandler();
+  Expr *E = nullptr;
+  if (!FollowStatement.contains(tok().getKind())) {
+    if (parseExpression(E))
+      return ErrorHandler();
+    if (!E)
+      return false;
+  }
+  Stmts.push_back(Ctx.create<ReturnStatement>(Loc, E));
+  return false;
+}
+
+bool Parser::parseExpList(llvm::SmallVectorImpl<Expr *> &Exprs) {
+  auto ErrorHandler = [&] {
+    Exprs.push_back(nullptr);
+    return skipUntil(FollowExpList);
+  };
+  Expr *E = nullptr;
+  if (parseExpression(E))
+    return ErrorHandler();
+  Exprs.push_back(E);
+  while (tok().is(tok::comma)) {
+    advance();
+    E = nullptr;
+    if (parseExpression(E))
+      return ErrorHandler();
+    Exprs.push_back(E);
+  }
+  return false;
+}
+
+bool Parser::parseExpression(Expr *&E) {
+  auto ErrorHandler = [&] {
+    E = nullptr;
+    return skipUntil(FollowExpression);
+  };
+  if (parseSimpleExpression(E))
+    return ErrorHandler();
+  if (RelationOps.contains(tok().getKind())) {
+    OperatorInfo Op(tok().getLocation(), tok().getKind());
+    advance();
+    Expr *Right = nullptr;
+    if (parseSimpleExpression(Right))
+      return ErrorHandler();
+    E = E && Right ? Ctx.create<InfixExpression>(E, Right, Op)
+                   : nullptr;
+  }
+  return false;
+}
+
+bool Parser::parseSimpleExpression(Expr *&E) {
+  auto ErrorHandler = [&] {
+    E = nullptr;
+    return skipUntil(FollowSimpleExpression);
+  };
+  bool HasPrefix = tok().isOneOf(tok::plus, tok::minus);
+  OperatorInfo Prefix(tok().getLocation(), tok().getKind());
+  if (HasPrefix)
+    advance();
+  if (parseTerm(E))
+    return ErrorHandler();
+  if (HasPrefix && E)
+    E = Ctx.create<PrefixExpression>(E, Prefix);
+  while (AddOps.contains(tok().getKind())) {
+    OperatorInfo Op(tok().getLocation(), tok().getKind());
+    advance();
+    Expr *Right = nullptr;
+    if (parseTerm(Right))
+      return ErrorHandler();
+    E = E && Right ? Ctx.create<InfixExpression>(E, Right, Op)
+                   : nullptr;
+  }
+  return false;
+}
+
+bool Parser::parseTerm(Expr *&E) {
+  auto ErrorHandler = [&] {
+    E = nullptr;
+    return skipUntil(FollowTerm);
+  };
+  if (parseFactor(E))
+    return ErrorHandler();
+  while (MulOps.contains(tok().getKind())) {
+    OperatorInfo Op(tok().getLocation(), tok().getKind());
+    advance();
+    Expr *Right = nullptr;
+    if (parseFactor(Right))
+      return ErrorHandler();
+    E = E && Right ? Ctx.create<InfixExpression>(E, Right, Op)
+                   : nullptr;
+  }
+  return false;
+}
+
+bool Parser::parseFactor(Expr *&E) {
+  auto ErrorHandler = [&] {
+    E = nullptr;
+    return skipUntil(FollowFactor);
+  };
+  switch (tok().getKind()) {
+  case tok::integer_literal:
+    E = Ctx.create<IntegerLiteral>(tok().getLocation(),
+                                   tok().getIntegerValue());
+    advance();
+    return false;
+  case tok::identifier: {
+    Qualident Name;
+    if (parseQualident(Name))
+      return ErrorHandler();
+    if (tok().isNot(tok::l_paren)) {
+      E = Ctx.create<Designator>(Name);
+      return false;
+    }
+    advance();
+    llvm::SmallVector<Expr *, 8> Params;
+    if (tok().isNot(tok::r_paren) && parseExpList(Params))
+      return ErrorHandler();
+    if (consume(tok::r_paren))
+      return ErrorHandler();
+    E = llvm::is_contained(Params, nullptr)
+            ? nullptr
+            : Ctx.create<FunctionCallExpr>(Name, copy(Params));
+    return false;
+  }
+  case tok::l_paren:
+    advance();
+    if (parseExpression(E))
+      return ErrorHandler();
+    if (consume(tok::r_paren))
+      return ErrorHandler();
+    return false;
+  case tok::kw_NOT: {
+    OperatorInfo Op(tok().getLocation(), tok().getKind());
+    advance();
+    if (parseFactor(E))
+      return ErrorHandler();
+    if (E)
+      E = Ctx.create<PrefixExpression>(E, Op);
+    return false;
+  }
+  default:
+    error("expression");
+    return ErrorHandler();
+  }
+}
+
+bool Parser::parseQualident(Qualident &Name) {
+  llvm::SmallVector<Ident, 4> Ids;
+  if (expect(tok::identifier))
+    return true;
+  Ids.push_back(getIdent(tok()));
+  advance();
+  while (tok().is(tok::period)) {
+    advance();
+    if (expect(tok::identifier))
+      return true;
+    Ids.push_back(getIdent(tok()));
+    advance();
+  }
+  Name = copy(Ids);
+  return false;
+}
+
+bool Parser::parseIdentList(llvm::SmallVectorImpl<Ident> &Ids) {
+  if (expect(tok::identifier))
+    return true;
+  Ids.push_back(getIdent(tok()));
+  advance();
+  while (tok().is(tok::comma)) {
+    advance();
+    if (expect(tok::identifier))
+      return true;
+    Ids.push_back(getIdent(tok()));
+    advance();
+  }
+  return false;
+}
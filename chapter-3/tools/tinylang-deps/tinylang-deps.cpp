@@ -0,0 +1,103 @@
+//===--- tinylang-deps.cpp - Module dependency loader ---------------------===//
+//
+// Loads a module and, transitively, all modules it imports with the
+// ModuleLoader, and prints the modules with their interfaces. With
+// -module-cache, interfaces of unchanged modules are taken from the
+// cache instead of lexing the modules again.
+//
+//===----------------------------------------------------------------------===//
+
+#include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Basic/Version.h"
+#include "tinylang/Loader/ModuleLoader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+
+using namespace tinylang;
+
+static llvm::cl::opt<std::string>
+    InputFile(llvm::cl::Positional, llvm::cl::Required,
+              llvm::cl::desc("<input-file>"));
+
+static llvm::cl::list<std::string> SearchPaths(
+    "I", llvm::cl::Prefix,
+    llvm::cl::desc("Search imported modules in <dir> (default: "
+                   "the directory of the input file)"),
+    llvm::cl::value_desc("dir"));
+
+static llvm::cl::opt<std::string> ModuleCache(
+    "module-cache",
+    llvm::cl::desc("Cache module interfaces in <dir>"),
+    llvm::cl::value_desc("dir"));
+
+static llvm::cl::opt<unsigned> Jobs(
+    "j",
+    llvm::cl::desc("Number of worker threads (default: all cores)"),
+    llvm::cl::init(0));
+
+static llvm::cl::opt<bool> PrintInterfaces(
+    "print-interfaces",
+    llvm::cl::desc("Print the declarations of every module"));
+
+int main(int argc, const char **argv) {
+  llvm::InitLLVM X(argc, argv);
+  llvm::cl::SetVersionPrinter([](llvm::raw_ostream &OS) {
+    OS << "tinylang-deps " << tinylang::getTinylangVersion()
+       << "\n";
+  });
+  llvm::cl::ParseCommandLineOptions(
+      argc, argv, "tinylang-deps - module dependency loader\n");
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr =
+      llvm::MemoryBuffer::getFile(InputFile);
+  if (std::error_code EC = FileOrErr.getError()) {
+    llvm::errs() << "Error reading " << InputFile << ": "
+                 << EC.message() << "\n";
+    return 1;
+  }
+
+  auto Start = std::chrono::steady_clock::now();
+  SourceMgr SrcMgr;
+  DiagnosticsEngine Diags(SrcMgr);
+  unsigned MainID =
+      SrcMgr.AddNewSourceBuffer(std::move(*FileOrErr), llvm::SMLoc());
+
+  ModuleLoader Loader(SrcMgr, Diags, Jobs);
+  for (const std::string &Dir : SearchPaths)
+    Loader.addSearchPath(Dir);
+  if (SearchPaths.empty()) {
+    StringRef Dir = llvm::sys::path::parent_path(InputFile);
+    Loader.addSearchPath(Dir.empty() ? "." : Dir);
+  }
+  Loader.setCacheDir(ModuleCache);
+  bool Success = Loader.loadImports(MainID);
+  std::chrono::duration<double> Elapsed =
+      std::chrono::steady_clock::now() - Start;
+
+  static const char *const DeclNames[] = {"CONST", "VAR",
+                                          "PROCEDURE"};
+  unsigned NumCached = 0;
+  for (const ModuleLoader::Module *M : Loader.modules()) {
+    NumCached += M->Cached;
+    llvm::outs() << M->Name;
+    if (!M->Path.empty())
+      llvm::outs() << " " << M->Path;
+    llvm::outs() << (M->Cached ? " (cached)" : "") << "\n";
+    for (const ModuleInterface::Import &I : M->Interface.Imports)
+      llvm::outs() << "  IMPORT " << I.Module << "\n";
+    if (PrintInterfaces)
+      for (const ModuleInterface::Decl &D : M->Interface.Decls)
+        llvm::outs() << "  " << DeclNames[D.Kind] << " " << D.Name
+                     << "\n";
+  }
+  llvm::outs() << llvm::format(
+      "%u modules, %u from the cache, loaded in %.3f s\n",
+      (unsigned)Loader.modules().size(), NumCached,
+      Elapsed.count());
+  return Success ? 0 : 1;
+}
@@ -0,0 +1,293 @@
+//===--- tinylang-lex.cpp - Parallel tinylang lexing driver ---------------===//
+//
+// Lexes many source files concurrently and reports the aggregate
+// throughput. All lexers share the read-only keyword table, while
+// SourceMgr and DiagnosticsEngine instances are private to the
+// worker thread lexing the file, so the threads don't share any
+// mutable state while lexing. With -parse, the files are parsed
+// as well, to compare the cost of parsing with the cost of lexing.
+//
+//===----------------------------------------------------------------------===//
+
+#include "tinylang/Basic/AllocStats.h"
+#include "tinylang/Basic/Diagnostic.h"
+#include "tinylang/Basic/Version.h"
+#include "tinylang/Lexer/Lexer.h"
+#include "tinylang/Lexer/StreamBuffer.h"
+#include "tinylang/Parser/Parser.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace tinylang;
+
+static llvm::cl::list<std::string>
+    InputFiles(llvm::cl::Positional,
+               llvm::cl::desc("<input-files>"));
+
+static llvm::cl::opt<std::string> FileList(
+    "file-list",
+    llvm::cl::desc("Read the names of the input files, one per "
+                   "line, from <file>"),
+    llvm::cl::value_desc("file"));
+
+static llvm::cl::opt<unsigned> Jobs(
+    "j",
+    llvm::cl::desc("Number of worker threads (default: all cores)"),
+    llvm::cl::init(0));
+
+static llvm::cl::opt<bool> Quiet(
+    "q", llvm::cl::desc("Don't print diagnostics, only count them"));
+
+static llvm::cl::opt<bool> Stream(
+    "stream",
+    llvm::cl::desc("Read the input in chunks instead of all at "
+                   "once; \"-\" reads stdin"));
+
+static llvm::cl::opt<unsigned> ChunkSize(
+    "chunk-size",
+    llvm::cl::desc("Size of the chunks read with -stream"),
+    llvm::cl::value_desc("bytes"), llvm::cl::init(64 * 1024));
+
+static llvm::cl::opt<bool> Parse(
+    "parse",
+    llvm::cl::desc("Parse the files instead of only lexing them"));
+
+static llvm::cl::opt<bool> AllocStats(
+    "alloc-stats",
+    llvm::cl::desc("Print allocation statistics per phase"));
+
+namespace {
+struct LexStats {
+  uint64_t Files = 0;
+  uint64_t Bytes = 0;
+  uint64_t Tokens = 0;
+  uint64_t Errors = 0;
+  uint64_t Unreadable = 0;
+  uint64_t ASTBytes = 0;
+
+  void add(const LexStats &Other) {
+    Files += Other.Files;
+    Bytes += Other.Bytes;
+    Tokens += Other.Tokens;
+    Errors += Other.Errors;
+    Unreadable += Other.Unreadable;
+    ASTBytes += Other.ASTBytes;
+  }
+};
+
+/// Diagnostics of one file are collected here and printed in one
+/// piece, so that the output of concurrently lexed files doesn't
+/// interleave.
+struct DiagCollector {
+  std::string Text;
+
+  static void handle(const llvm::SMDiagnostic &Diag, void *Ctx) {
+    auto *Self = static_cast<DiagCollector *>(Ctx);
+    llvm::raw_string_ostream OS(Self->Text);
+    Diag.print(nullptr, OS);
+  }
+};
+
+std::mutex OutputMutex;
+
+void reportDiagnostics(const DiagCollector &Collector) {
+  if (!Quiet && !Collector.Text.empty()) {
+    std::lock_guard<std::mutex> Lock(OutputMutex);
+    llvm::errs() << Collector.Text;
+  }
+}
+
+/// Lexes one file in chunks, so its size isn't limited by memory.
+void streamFile(const std::string &FileName, LexStats &Stats) {
+  llvm::Expected<std::unique_ptr<StreamBuffer>> StreamOrErr =
+      StreamBuffer::open(FileName, ChunkSize);
+  if (!StreamOrErr) {
+    std::lock_guard<std::mutex> Lock(OutputMutex);
+    llvm::errs() << "Error reading " << FileName << ": "
+                 << llvm::toString(StreamOrErr.takeError()) << "\n";
+    ++Stats.Unreadable;
+    return;
+  }
+
+  SourceMgr SrcMgr;
+  DiagCollector Collector;
+  SrcMgr.setDiagHandler(DiagCollector::handle, &Collector);
+  DiagnosticsEngine Diags(SrcMgr);
+  {
+    allocstats::Scope InLexer(allocstats::Lexer);
+    Lexer Lex(SrcMgr, Diags, **StreamOrErr);
+    Token Tok;
+    do {
+      Lex.next(Tok);
+      ++Stats.Tokens;
+    } while (Tok.isNot(tok::eof));
+  }
+
+  if (std::error_code EC = (*StreamOrErr)->getError()) {
+    std::lock_guard<std::mutex> Lock(OutputMutex);
+    llvm::errs() << "Error reading " << FileName << ": "
+                 << EC.message() << "\n";
+    ++Stats.Unreadable;
+  }
+  ++Stats.Files;
+  Stats.Bytes += (*StreamOrErr)->getBytesRead();
+  Stats.Errors += Diags.numErrors();
+  reportDiagnostics(Collector);
+}
+
+/// Lexes one file with the worker's own SourceMgr and
+/// DiagnosticsEngine.
+void lexFile(const std::string &FileName, LexStats &Stats) {
+  if (Stream)
+    return streamFile(FileName, Stats);
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> FileOrErr =
+      llvm::MemoryBuffer::getFile(FileName);
+  if (std::error_code EC = FileOrErr.getError()) {
+    std::lock_guard<std::mutex> Lock(OutputMutex);
+    llvm::errs() << "Error reading " << FileName << ": "
+                 << EC.message() << "\n";
+    ++Stats.Unreadable;
+    return;
+  }
+
+  SourceMgr SrcMgr;
+  DiagCollector Collector;
+  SrcMgr.setDiagHandler(DiagCollector::handle, &Collector);
+  Stats.Bytes += (*FileOrErr)->getBufferSize();
+  SrcMgr.AddNewSourceBuffer(std::move(*FileOrErr), llvm::SMLoc());
+  DiagnosticsEngine Diags(SrcMgr);
+
+  if (Parse) {
+    // The lexer runs on demand of the parser, so its allocations
+    // are counted for the parser.
+    allocstats::Scope InParser(allocstats::Parser);
+    ASTContext Ctx;
+    Lexer Lex(SrcMgr, Diags);
+    Parser P(Lex, Ctx);
+    P.parse();
+    Stats.Tokens += P.getNumTokens();
+    Stats.ASTBytes += Ctx.getBytesAllocated();
+  } else {
+    allocstats::Scope InLexer(allocstats::Lexer);
+    Lexer Lex(SrcMgr, Diags);
+    Token Tok;
+    do {
+      Lex.next(Tok);
+      ++Stats.Tokens;
+    } while (Tok.isNot(tok::eof));
+  }
+
+  ++Stats.Files;
+  Stats.Errors += Diags.numErrors();
+  reportDiagnostics(Collector);
+}
+
+bool readFileList(std::vector<std::string> &Files) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> ListOrErr =
+      llvm::MemoryBuffer::getFileOrSTDIN(FileList);
+  if (std::error_code EC = ListOrErr.getError()) {
+    llvm::errs() << "Error reading " << FileList << ": "
+                 << EC.message() << "\n";
+    return false;
+  }
+  llvm::SmallVector<StringRef, 64> Lines;
+  (*ListOrErr)->getBuffer().split(Lines, '\n', -1,
+                                  /*KeepEmpty=*/false);
+  for (StringRef Line : Lines) {
+    Line = Line.trim();
+    if (!Line.empty())
+      Files.push_back(Line.str());
+  }
+  return true;
+}
+} // namespace
+
+int main(int argc, const char **argv) {
+  llvm::InitLLVM X(argc, argv);
+  llvm::cl::SetVersionPrinter([](llvm::raw_ostream &OS) {
+    OS << "tinylang-lex " << tinylang::getTinylangVersion()
+       << "\n";
+  });
+  llvm::cl::ParseCommandLineOptions(
+      argc, argv, "tinylang-lex - parallel lexing driver\n");
+
+  if (AllocStats) {
+    if (!allocstats::isSupported())
+      llvm::errs()
+          << "--alloc-stats is not supported on this platform\n";
+    allocstats::enable();
+  }
+
+  std::vector<std::string> Files(InputFiles.begin(),
+                                 InputFiles.end());
+  if (!FileList.empty() && !readFileList(Files))
+    return 1;
+  if (Files.empty()) {
+    llvm::errs() << "No input files\n";
+    return 1;
+  }
+  if (Parse && Stream) {
+    llvm::errs() << "-parse can't be combined with -stream\n";
+    return 1;
+  }
+
+  // Files are handed out through a shared atomic cursor: a worker
+  // that runs out of work takes the next file, so large and small
+  // files balance out across the threads without any locking.
+  llvm::ThreadPoolStrategy Strategy =
+      llvm::hardware_concurrency(Jobs);
+  unsigned NumWorkers = std::min<size_t>(
+      Strategy.compute_thread_count(), Files.size());
+  std::vector<LexStats> WorkerStats(NumWorkers);
+  std::atomic<size_t> NextFile(0);
+
+  auto Start = std::chrono::steady_clock::now();
+  {
+    llvm::ThreadPool Pool(Strategy);
+    for (unsigned I = 0; I < NumWorkers; ++I)
+      Pool.async([&, I] {
+        LexStats &Stats = WorkerStats[I];
+        for (size_t Idx = NextFile++; Idx < Files.size();
+             Idx = NextFile++)
+          lexFile(Files[Idx], Stats);
+      });
+    Pool.wait();
+  }
+  std::chrono::duration<double> Elapsed =
+      std::chrono::steady_clock::now() - Start;
+
+  LexStats Total;
+  for (const LexStats &Stats : WorkerStats)
+    Total.add(Stats);
+
+  double Seconds = Elapsed.count();
+  llvm::outs() << llvm::format(
+      "%llu files, %llu bytes, %llu tokens, %llu errors in "
+      "%.3f s with %u threads\n",
+      (unsigned long long)Total.Files,
+      (unsigned long long)Total.Bytes,
+      (unsigned long long)Total.Tokens,
+      (unsigned long long)Total.Errors, Seconds, NumWorkers);
+  if (Seconds > 0)
+    llvm::outs() << llvm::format(
+        "%.1f MB/s, %.2f Mtokens/s, %.0f files/s\n",
+        Total.Bytes / Seconds / 1e6,
+        Total.Tokens / Seconds / 1e6, Total.Files / Seconds);
+  if (Parse)
+    llvm::outs() << llvm::format("%llu bytes of AST\n",
+                                 (unsigned long long)Total.ASTBytes);
+  if (AllocStats)
+    allocstats::print(llvm::errs());
+  return (Total.Errors || Total.Unreadable) ? 1 : 0;
+}